@@ -1,40 +1,39 @@
+#include <algorithm> // count_if, min, max
+
 #include "applyoperator.h"
+#include "hwcounters.h"
 #include "routines.h"
+#include "statememory.h"
+#include "timer.h"
 
 #ifdef DEBUG
-#include "debug.h"
+#include "eventlog.h"
 #endif
 
-#ifdef DEBUG
-void PrintVector(const Vector& psi)
-{
-    for (auto x: psi)
-    {
-        cout << INDENT(5) << x << endl;
-    }
-}
+using std::count_if;
+using std::max;
+using std::min;
 
-void PrintMatrix(const Matrix& U)
-{
-    cout << INDENT(5) << U[0][0] << " " << U[0][1] << endl;
-    cout << INDENT(5) << U[1][0] << " " << U[1][1] << endl;
-}
-#endif
+/*
+    Bytes and floating point operations of kernels given to HwCounters:
+    each element is read and written once, a complex multiplication takes
+    6 operations and addition 2, so a 2x2 matrix costs 14 operations per
+    element and a 4x4 matrix 30.
+*/
 
 void ApplyOperator(Vector& psi, const Matrix& U, const int k)
 {
+    PhaseTimer timer(Stats::phase_compute);
+    HwCounters::Scope counters(HwCounters::kernel_apply,
+        2.0 * psi.size() * sizeof(complexd), 14.0 * psi.size());
     const Index N = psi.size();
     const int n = intlog2(N);
-    const Index mask = 1L << (n - k);
+    const Index mask = Index(1) << (n - k);
 
     #ifdef DEBUG
-    cout << INDENT(3) << "ApplyOperator()..." << endl;
-    cout << INDENT(4) << "psi:" << endl;
-    PrintVector(psi);
-    cout << INDENT(4) << "Matrix U:" << endl;
-    PrintMatrix(U);
-    cout << INDENT(4) << "target_qubit = " << k << endl;
-    cout << INDENT(4) << "Applying operator..." << endl;
+    EventLog::Record(EventLog::apply_operator_begin, k);
+    EventLog::RecordVector(psi);
+    EventLog::RecordMatrix(U);
     #endif
 
     for (Index i = 0; i < N; i++)
@@ -53,10 +52,154 @@ void ApplyOperator(Vector& psi, const Matrix& U, const int k)
         }
     }
     #ifdef DEBUG
-    cout << INDENT(4) << "Applying operator DONE" << endl;
-    cout << INDENT(4) << "psi:" << endl;
-    PrintVector(psi);
-    cout << INDENT(3) << "ApplyOperator() return" << endl;
+    EventLog::RecordVector(psi);
+    EventLog::Record(EventLog::apply_operator_end);
+    #endif
+}
+
+/*
+    Single pass over the vector: every block is loaded once and all qubits
+    with stride less than block size are transformed while it is in cache
+    (or in memory, for out-of-core vectors). Next block is prefetched.
+*/
+void ApplyOperatorBlocked(Vector& psi, const vector<Matrix>& U,
+    const Index block_size)
+{
+    PhaseTimer timer(Stats::phase_compute);
+    const double gate_count = count_if(U.begin(), U.end(),
+        [](const Matrix& m) { return !m.empty(); });
+    HwCounters::Scope counters(HwCounters::kernel_apply,
+        2.0 * psi.size() * sizeof(complexd),
+        gate_count * 14.0 * psi.size());
+    #ifdef DEBUG
+    EventLog::Record(EventLog::apply_operator_blocked_begin, 0, block_size);
+    #endif
+
+    const Index N = psi.size();
+    for (Index first = 0; first < N; first += block_size)
+    {
+        if (first + block_size < N)
+        {
+            StateMemory::Prefetch(&psi[first + block_size],
+                block_size * sizeof(complexd));
+        }
+
+        complexd* const block = &psi[first];
+        for (int j = intlog2(block_size) - 1; j >= 0; j--)
+        {
+            if (U[j].empty())
+            {
+                continue;
+            }
+            const Index mask = Index(1) << j;
+            const complexd u00 = U[j][0][0];
+            const complexd u01 = U[j][0][1];
+            const complexd u10 = U[j][1][0];
+            const complexd u11 = U[j][1][1];
+            for (Index i = 0; i < block_size; i++)
+            {
+                if ((i & mask) == 0)
+                {
+                    const complexd a = block[i];
+                    const complexd b = block[i | mask];
+
+                    block[i] = u00 * a + u01 * b;
+                    block[i | mask] = u10 * a + u11 * b;
+                }
+            }
+        }
+    }
+
+    #ifdef DEBUG
+    EventLog::RecordVector(psi);
+    EventLog::Record(EventLog::apply_operator_blocked_end);
+    #endif
+}
+
+// inserts zero bit at position of mask into k
+static inline Index InsertZeroBit(const Index k, const Index mask)
+{
+    return ((k & ~(mask - 1)) << 1) | (k & (mask - 1));
+}
+
+void ApplyControlledOperator(Vector& psi, const Matrix& U,
+    const Index control_mask, const Index target_mask)
+{
+    PhaseTimer timer(Stats::phase_compute);
+    // controlled gate touches half of the elements
+    const double touched = control_mask ? psi.size() / 2 : psi.size();
+    HwCounters::Scope counters(HwCounters::kernel_apply,
+        2.0 * touched * sizeof(complexd), 14.0 * touched);
+    #ifdef DEBUG
+    EventLog::Record(EventLog::apply_controlled_operator_begin, 0,
+        control_mask, double(target_mask));
+    #endif
+
+    const complexd u00 = U[0][0];
+    const complexd u01 = U[0][1];
+    const complexd u10 = U[1][0];
+    const complexd u11 = U[1][1];
+
+    // k enumerates elements with target and control bits unset
+    const Index low = control_mask ? min(control_mask, target_mask) :
+        target_mask;
+    const Index high = control_mask ? max(control_mask, target_mask) : 0;
+    const Index count = psi.size() / (control_mask ? 4 : 2);
+    for (Index k = 0; k < count; k++)
+    {
+        Index i = InsertZeroBit(k, low);
+        if (high)
+        {
+            i = InsertZeroBit(i, high);
+        }
+        const Index i0 = i | control_mask;
+        const Index i1 = i0 | target_mask;
+
+        const complexd a = psi[i0];
+        const complexd b = psi[i1];
+
+        psi[i0] = u00 * a + u01 * b;
+        psi[i1] = u10 * a + u11 * b;
+    }
+
+    #ifdef DEBUG
+    EventLog::Record(EventLog::apply_controlled_operator_end);
     #endif
 }
 
+void ApplyTwoQubitOperator(Vector& psi, const Matrix& U,
+    const Index first_mask, const Index second_mask)
+{
+    PhaseTimer timer(Stats::phase_compute);
+    HwCounters::Scope counters(HwCounters::kernel_apply,
+        2.0 * psi.size() * sizeof(complexd), 30.0 * psi.size());
+    #ifdef DEBUG
+    EventLog::Record(EventLog::apply_two_qubit_operator_begin, 0,
+        first_mask, double(second_mask));
+    #endif
+
+    const Index low = min(first_mask, second_mask);
+    const Index high = max(first_mask, second_mask);
+    const Index count = psi.size() / 4;
+    for (Index k = 0; k < count; k++)
+    {
+        const Index i = InsertZeroBit(InsertZeroBit(k, low), high);
+        // basis order |first second>
+        const Index index[4] = {i, i | second_mask, i | first_mask,
+            i | first_mask | second_mask};
+        complexd a[4];
+        for (int r = 0; r < 4; r++)
+        {
+            a[r] = psi[index[r]];
+        }
+        for (int r = 0; r < 4; r++)
+        {
+            psi[index[r]] = U[r][0] * a[0] + U[r][1] * a[1] +
+                U[r][2] * a[2] + U[r][3] * a[3];
+        }
+    }
+
+    #ifdef DEBUG
+    EventLog::Record(EventLog::apply_two_qubit_operator_end);
+    #endif
+}
@@ -4,5 +4,21 @@
 #include "typedefs.h"
 
 void ApplyOperator(Vector& psi, const Matrix& U, const int k);
+/*
+    Applies U[j] to the qubit with stride 2**j for every j such that
+    2**j < block_size, empty matrices are skipped
+*/
+void ApplyOperatorBlocked(Vector& psi, const vector<Matrix>& U,
+    const Index block_size);
+/*
+    Applies 2x2 U to the qubit with stride target_mask where the qubit
+    with stride control_mask is set, everywhere if control_mask is 0.
+    Elements with control unset are not touched.
+*/
+void ApplyControlledOperator(Vector& psi, const Matrix& U,
+    const Index control_mask, const Index target_mask);
+// applies 4x4 U in basis |first second> to qubits with given strides
+void ApplyTwoQubitOperator(Vector& psi, const Matrix& U,
+    const Index first_mask, const Index second_mask);
 
 #endif
@@ -3,10 +3,26 @@
 Args::Args():
     qubit_count(-1),
     iteration_count(1),
-    epsilon(0.0),
+    product_state(false),
+    preflight(false),
+    per_qubit_noise(false),
+    group_size(0),
+    epsilons(1, 0.0),
+    target_relative_error(0.0),
     fidelity_filename(NULL),
     computation_time_filename(NULL),
-    stats_filename(NULL)
+    stats_filename(NULL),
+    stats_json_filename(NULL),
+    out_of_core_dir(NULL),
+    checkpoint_prefix(NULL),
+    checkpoint_interval(1),
+    restart(false),
+    job_filename(NULL),
+    circuit_filename(NULL),
+    trace_filename(NULL),
+    hw_counters_filename(NULL),
+    autotune_filename(NULL),
+    exchange_format(ExchangeCodec::format_raw)
 {
 
 }
@@ -21,9 +37,39 @@ int Args::IterationCount() const
     return iteration_count;
 }
 
-double Args::Epsilon() const
+const vector<double>& Args::Epsilons() const
 {
-    return epsilon;
+    return epsilons;
+}
+
+bool Args::ProductStateFlag() const
+{
+    return product_state;
+}
+
+bool Args::PreflightFlag() const
+{
+    return preflight;
+}
+
+bool Args::PerQubitNoiseFlag() const
+{
+    return per_qubit_noise;
+}
+
+int Args::GroupSize() const
+{
+    return group_size;
+}
+
+double Args::TargetRelativeError() const
+{
+    return target_relative_error;
+}
+
+bool Args::TargetRelativeErrorFlag() const
+{
+    return target_relative_error > 0.0;
 }
 
 string Args::FidelityFileName() const
@@ -55,3 +101,103 @@ bool Args::StatsWriteToFileFlag() const
 {
     return stats_filename;
 }
+
+string Args::StatsJsonFileName() const
+{
+    return stats_json_filename;
+}
+
+bool Args::StatsJsonWriteToFileFlag() const
+{
+    return stats_json_filename;
+}
+
+string Args::OutOfCoreDir() const
+{
+    return out_of_core_dir;
+}
+
+bool Args::OutOfCoreFlag() const
+{
+    return out_of_core_dir;
+}
+
+string Args::CheckpointPrefix() const
+{
+    return checkpoint_prefix;
+}
+
+bool Args::CheckpointFlag() const
+{
+    return checkpoint_prefix;
+}
+
+int Args::CheckpointInterval() const
+{
+    return checkpoint_interval;
+}
+
+bool Args::RestartFlag() const
+{
+    return restart;
+}
+
+string Args::JobFileName() const
+{
+    return job_filename;
+}
+
+bool Args::JobServerFlag() const
+{
+    return job_filename;
+}
+
+string Args::CircuitFileName() const
+{
+    return circuit_filename;
+}
+
+bool Args::CircuitFileFlag() const
+{
+    return circuit_filename;
+}
+
+const Circuit& Args::CircuitSpec() const
+{
+    return circuit;
+}
+
+string Args::TraceFileName() const
+{
+    return trace_filename;
+}
+
+bool Args::TraceFlag() const
+{
+    return trace_filename;
+}
+
+string Args::HwCountersFileName() const
+{
+    return hw_counters_filename;
+}
+
+bool Args::HwCountersFlag() const
+{
+    return hw_counters_filename;
+}
+
+string Args::AutotuneFileName() const
+{
+    return autotune_filename;
+}
+
+bool Args::AutotuneFlag() const
+{
+    return autotune_filename;
+}
+
+ExchangeCodec::Format Args::ExchangeFormat() const
+{
+    return exchange_format;
+}
@@ -2,8 +2,13 @@
 #define ARGS_H
 
 #include <string>
+#include <vector>
+
+#include "circuit.h"
+#include "exchangecodec.h"
 
 using std::string;
+using std::vector;
 
 class Args
 {
@@ -11,24 +16,80 @@ class Args
 
     int qubit_count;
     int iteration_count;
-    double epsilon;
+    // initial state is a product of random single-qubit states
+    bool product_state;
+    // only print memory requirements and exit
+    bool preflight;
+    // every qubit gets its own noise sample instead of a shared one
+    bool per_qubit_noise;
+    // number of processes sharing one state vector, zero means 'auto'
+    int group_size;
+    vector<double> epsilons;
+    // zero means 'run all iterations'
+    double target_relative_error;
     // NULL means 'not specified by user', "-" means 'write to stdout'
     char* fidelity_filename;
     char* computation_time_filename;
     char* stats_filename;
+    char* stats_json_filename;
+    // NULL means 'keep vectors in memory'
+    char* out_of_core_dir;
+    // NULL means 'no checkpoints'
+    char* checkpoint_prefix;
+    int checkpoint_interval;
+    bool restart;
+    // NULL means 'single run', "-" means 'read jobs from stdin'
+    char* job_filename;
+    // NULL means 'hadamard gate on every qubit'
+    char* circuit_filename;
+    // NULL means 'no trace'
+    char* trace_filename;
+    // NULL means 'no hardware counters'
+    char* hw_counters_filename;
+    // NULL means 'default block and chunk sizes, no tuning'
+    char* autotune_filename;
+    // encoding of ranges sent to partners on other nodes
+    ExchangeCodec::Format exchange_format;
+    Circuit circuit;
 
     public:
 
     Args();
     int QubitCount() const;
     int IterationCount() const;
-    double Epsilon() const;
+    bool ProductStateFlag() const;
+    bool PreflightFlag() const;
+    bool PerQubitNoiseFlag() const;
+    int GroupSize() const;
+    const vector<double>& Epsilons() const;
+    double TargetRelativeError() const;
+    bool TargetRelativeErrorFlag() const;
     string FidelityFileName() const;
     bool FidelityWriteToFileFlag() const;
     string ComputationTimeFileName() const;
     bool ComputationTimeWriteToFileFlag() const;
     string StatsFileName() const;
     bool StatsWriteToFileFlag() const;
+    string StatsJsonFileName() const;
+    bool StatsJsonWriteToFileFlag() const;
+    string OutOfCoreDir() const;
+    bool OutOfCoreFlag() const;
+    string CheckpointPrefix() const;
+    bool CheckpointFlag() const;
+    int CheckpointInterval() const;
+    bool RestartFlag() const;
+    string JobFileName() const;
+    bool JobServerFlag() const;
+    string CircuitFileName() const;
+    bool CircuitFileFlag() const;
+    const Circuit& CircuitSpec() const;
+    string TraceFileName() const;
+    bool TraceFlag() const;
+    string HwCountersFileName() const;
+    bool HwCountersFlag() const;
+    string AutotuneFileName() const;
+    bool AutotuneFlag() const;
+    ExchangeCodec::Format ExchangeFormat() const;
 };
 
 #endif
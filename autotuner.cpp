@@ -0,0 +1,262 @@
+#include <algorithm> // min, min_element
+#include <cmath> // sqrt
+#include <fstream> // ifstream, ofstream
+#include <iostream> // std::cerr
+#include <sstream> // ostringstream, istringstream
+#include <unistd.h> // gethostname
+
+#ifdef DEBUG
+#include "debug.h"
+#endif
+
+#include "autotuner.h"
+#include "applyoperator.h"
+#include "backend.h"
+#include "computationbase.h"
+#include "computationparams.h"
+#include "nodeshm.h"
+#include "routines.h"
+#include "workerbase.h"
+
+using std::cerr;
+using std::endl;
+using std::getline;
+using std::ifstream;
+using std::istringstream;
+using std::min;
+using std::min_element;
+using std::ofstream;
+using std::ostringstream;
+using std::sqrt;
+
+const Index Autotuner::max_tune_size = Index(1) << 22;
+
+string Autotuner::ProfileKey(const Args& args)
+{
+    char hostname[256] = "";
+    gethostname(hostname, sizeof(hostname) - 1);
+    ostringstream oss;
+    oss << hostname << " " << Backend::NPes() << " " << NodeShm::NodeCount()
+        << " " << args.QubitCount() << " "
+        << ComputationParams::GroupSize(args);
+    return oss.str();
+}
+
+// the last line with key wins, missing file is an empty profile
+bool Autotuner::ProfileRead(const string& filename, const string& key,
+    Settings& settings)
+{
+    ifstream fs(filename.c_str());
+    string line;
+    bool found = false;
+    while (getline(fs, line))
+    {
+        istringstream iss(line.substr(0, line.find('#')));
+        string field;
+        string line_key;
+        for (int i = 0; i < 5 && iss >> field; i++)
+        {
+            line_key += (i ? " " : "") + field;
+        }
+        Settings s;
+        if (line_key == key && iss >> s.block_size >> s.chunk_size)
+        {
+            settings = s;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void Autotuner::ProfileAppend(const string& filename, const string& key,
+    const Settings& settings, const bool chunk_size_tuned)
+{
+    const bool exists = ifstream(filename.c_str()).good();
+    ofstream fs(filename.c_str(), std::ios::app);
+    if (!exists)
+    {
+        fs << "# host pes nodes qubits group_size block_size chunk_size"
+            << endl;
+    }
+    fs << key << " " << settings.block_size << " " << settings.chunk_size
+        << (chunk_size_tuned ? "" : " # chunk_size not tuned") << endl;
+    if (!fs)
+    {
+        cerr << "Cannot write autotuning profile " << filename << endl;
+    }
+}
+
+/*
+    Sums seconds of each candidate over PEs so that all choose alike.
+    The first candidate is the default, it is kept unless another one is
+    faster by more than noise.
+*/
+Index Autotuner::Fastest(const vector<Index>& candidates,
+    vector<double>& seconds)
+{
+    const double min_gain = 0.05;
+    Backend::DoubleAllSum(seconds.data(), seconds.size());
+    const auto best = min_element(seconds.begin(), seconds.end());
+    if (*best < seconds.front() * (1.0 - min_gain))
+    {
+        return candidates[best - seconds.begin()];
+    }
+    return candidates.front();
+}
+
+// times hadamard gates on every local qubit as WorkerBase::ApplySingle
+Index Autotuner::TuneBlockSize(const Index size)
+{
+    const complexd elem = 1.0 / sqrt(2.0);
+    Matrix U(2, Vector(2, elem));
+    U[1][1] = -elem;
+    Vector psi(size, 1.0 / sqrt(double(size)));
+
+    const vector<Index> all = {0, 1, Index(1) << 10, Index(1) << 12,
+        Index(1) << 14, Index(1) << 16, Index(1) << 18, Index(1) << 20};
+    vector<Index> candidates;
+    vector<double> seconds;
+    for (auto c: all)
+    {
+        if (c > size)
+        {
+            continue;
+        }
+        const Index block_size = min(c ? c : WorkerBase::default_block_size,
+            size);
+        const vector<Matrix> blocked(intlog2(block_size), U);
+        double best = 0.0;
+        for (int i = 0; i < repetition_count; i++)
+        {
+            const double start = Backend::Time();
+            for (int k = 1; k <= intlog2(size); k++)
+            {
+                if ((size >> k) >= block_size)
+                {
+                    ::ApplyOperator(psi, U, k);
+                }
+            }
+            if (!blocked.empty())
+            {
+                ::ApplyOperatorBlocked(psi, blocked, block_size);
+            }
+            const double t = Backend::Time() - start;
+            best = i ? min(best, t) : t;
+        }
+        candidates.push_back(c);
+        seconds.push_back(best);
+    }
+    return Fastest(candidates, seconds);
+}
+
+/*
+    Times exchange of half the vector between PEs on different nodes,
+    partners of one node are in the next block of PEs. Chunk size does
+    not matter within a node, so false if no PE has a partner elsewhere.
+*/
+bool Autotuner::TuneChunkSize(const Index size, Index& chunk_size)
+{
+    chunk_size = 0;
+    if (Backend::NPes() < 2 || !Backend::SetChunkSize(0))
+    {
+        return false;
+    }
+
+    const Index half = size / 2;
+    const int pes_per_node = Backend::NPes() / NodeShm::NodeCount();
+    const int partner = Backend::MyPe() ^ pes_per_node;
+    const bool cross_node = partner < Backend::NPes() &&
+        !NodeShm::SameNode(partner);
+    const Index count = cross_node ? half : 0;
+    double pair_count = cross_node;
+    Backend::DoubleAllSum(&pair_count, 1);
+    if (pair_count == 0.0)
+    {
+        return false;
+    }
+    Vector data(half);
+    Vector buffer(Backend::exchange_needs_buffer ? half : 0);
+
+    const vector<Index> all = {0, Index(1) << 4, Index(1) << 8,
+        Index(1) << 12, Index(1) << 16, Index(1) << 20};
+    vector<Index> candidates;
+    vector<double> seconds;
+    for (auto c: all)
+    {
+        if (c > half)
+        {
+            continue;
+        }
+        Backend::SetChunkSize(c);
+        double best = 0.0;
+        for (int i = 0; i < repetition_count; i++)
+        {
+            Backend::BarrierAll();
+            const double start = Backend::Time();
+            Backend::ExchangeWithPartner(data.begin(), data.begin() + count,
+                buffer.begin(), partner);
+            const double t = Backend::Time() - start;
+            best = i ? min(best, t) : t;
+        }
+        candidates.push_back(c);
+        seconds.push_back(best);
+    }
+    Backend::SetChunkSize(0);
+    chunk_size = Fastest(candidates, seconds);
+    return true;
+}
+
+/*
+    Master looks the shape up in the profile and sends what it found.
+    Product states have neither blocked passes nor exchanges.
+*/
+Autotuner::Settings Autotuner::Find(const Args& args)
+{
+    Settings result = {0, 0};
+    if (args.ProductStateFlag())
+    {
+        return result;
+    }
+
+    const bool master = Backend::MyPe() == ComputationBase::master_rank;
+    const string key = master ? ProfileKey(args) : "";
+    double found[3] = {0.0, 0.0, 0.0};
+    if (master && ProfileRead(args.AutotuneFileName(), key, result))
+    {
+        found[0] = 1.0;
+        found[1] = result.block_size;
+        found[2] = result.chunk_size;
+    }
+    Backend::DoubleToAll(found, 3, ComputationBase::master_rank);
+    if (found[0] != 0.0)
+    {
+        result.block_size = found[1];
+        result.chunk_size = found[2];
+    }
+    else
+    {
+        const Index size = min((Index(1) << args.QubitCount()) /
+            ComputationParams::GroupSize(args), max_tune_size);
+        result.block_size = args.OutOfCoreFlag() ? 0 : TuneBlockSize(size);
+        const bool chunk_size_tuned = TuneChunkSize(size, result.chunk_size);
+        if (master)
+        {
+            ProfileAppend(args.AutotuneFileName(), key, result,
+                chunk_size_tuned);
+        }
+    }
+
+    #ifdef DEBUG
+    cout << "Autotuner::Find(): block_size = " << result.block_size
+        << ", chunk_size = " << result.chunk_size
+        << (found[0] != 0.0 ? " from profile" : " tuned") << endl;
+    #endif
+
+    return result;
+}
+
+void Autotuner::Apply(const Settings& settings)
+{
+    WorkerBase::SetBlockSize(settings.block_size);
+    Backend::SetChunkSize(settings.chunk_size);
+}
@@ -0,0 +1,54 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <string>
+
+#include "args.h"
+#include "typedefs.h"
+
+using std::string;
+
+/*
+    Chooses block size of single-qubit passes (1 means a pass per qubit
+    instead of the blocked kernel) and elements per exchange message by
+    timing candidates on the local vector size of the run. Settings are
+    kept in a profile file, one line per machine and problem shape:
+
+        # host pes nodes qubits group_size block_size chunk_size
+        node01 8 2 30 8 16384 0
+
+    0 stands for the default of the build. Chunk size is tuned only
+    between nodes, lines of runs without such exchanges note that it was
+    not tuned. Shapes found in the profile are not tuned again, delete
+    the line to tune anew.
+*/
+class Autotuner
+{
+    public:
+    struct Settings
+    {
+        Index block_size;
+        Index chunk_size;
+    };
+
+    private:
+    // vector of tuning runs is at most this long, blocks fit in cache
+    static const Index max_tune_size;
+    static const int repetition_count = 3;
+    static string ProfileKey(const Args& args);
+    static bool ProfileRead(const string& filename, const string& key,
+        Settings& settings);
+    static void ProfileAppend(const string& filename, const string& key,
+        const Settings& settings, const bool chunk_size_tuned);
+    static Index TuneBlockSize(const Index size);
+    static bool TuneChunkSize(const Index size, Index& chunk_size);
+    static Index Fastest(const vector<Index>& candidates,
+        vector<double>& seconds);
+
+    public:
+    // collective, settings of the profile or of a new tuning run
+    static Settings Find(const Args& args);
+    static void Apply(const Settings& settings);
+};
+
+#endif
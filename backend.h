@@ -0,0 +1,71 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <functional> // function
+
+#include "typedefs.h"
+
+using std::function;
+
+/*
+    Communication between processing elements (PEs). Exactly one
+    implementation is linked in, it is selected by BACKEND variable of the
+    makefile:
+        dislib  - one process per PE, active messages of DISLIB
+        mpi     - one process per PE, point-to-point messages and
+                  collectives of MPI
+        threads - all PEs are threads of one process sharing memory
+*/
+class Backend
+{
+    public:
+    // the first call of the program and the last one
+    static void Init(int* argc, char*** argv);
+    static void Finalize();
+    /*
+        Calls pe_main on every PE of this process and returns the largest
+        of their exit codes
+    */
+    static int Run(const function<int()>& pe_main);
+    /*
+        Ends all PEs with exit_code, for errors hitting only some PEs
+        while their partners would wait for them forever
+    */
+    static void Abort(const int exit_code);
+    static int MyPe();
+    static int NPes();
+    static void BarrierAll();
+    // copies count values of root to all PEs
+    static void DoubleToAll(double* x, const Index count, const int root);
+    // sums each of count values over all PEs
+    static void DoubleAllSum(double* x, const Index count);
+    /*
+        Collective, root receives count values of every PE, counts may
+        differ between PEs. Returns them one PE after another in PE order
+        on root and nothing elsewhere. Meant for reports written by root,
+        not counted in Stats.
+    */
+    static vector<double> DoubleGather(const double* x, const Index count,
+        const int root);
+    /*
+        Replaces [first, last) by the range of the same size given by
+        partner_pe, both PEs must call it. buffer must hold last - first
+        elements if exchange_needs_buffer is set. Collective, all PEs call
+        it, those not exchanging pass an empty range.
+    */
+    static void ExchangeWithPartner(
+        const Vector::iterator& first,
+        const Vector::iterator& last,
+        const Vector::iterator& buffer,
+        const int partner_pe);
+    static const bool exchange_needs_buffer;
+    /*
+        Elements per message of ExchangeWithPartner, 0 restores the
+        default. Returns false if the backend does not split exchanges.
+    */
+    static bool SetChunkSize(const Index chunk_size);
+    // wall clock time in seconds
+    static double Time();
+};
+
+#endif
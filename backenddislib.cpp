@@ -0,0 +1,301 @@
+#include <dislib.h>
+#include <algorithm> // copy, min
+#include <cstdlib> // exit
+#include <cstring> // memcpy, strlen
+#include <iterator> // std::distance
+#include <unistd.h> // gethostname
+#include "backend.h"
+#include "nodeshm.h"
+#include "statememory.h"
+#include "stats.h"
+#include "timer.h"
+
+#ifdef DEBUG
+#include "eventlog.h"
+#endif
+
+using std::copy;
+using std::distance;
+using std::min;
+
+/*
+    Elements of a vector are sent as active messages, each message holds
+    index of its first element followed by chunk_size elements or less.
+    Chunk of one element is an IndexElemPair.
+*/
+class Shmem
+{
+    friend ShmemHandler ShmemReceiveElem;
+    static Vector::iterator receive_first;
+    static Index chunk_size;
+    // reused by SendVector, DISLIB copies messages
+    static vector<char> message;
+    public:
+    static const Index default_chunk_size = 1;
+    static int HandlerNumber();
+    static void SetChunkSize(const Index chunk_size);
+    static void SetReceiveVector(const Vector::iterator& first);
+    static void SendVector(
+        const Vector::const_iterator& first,
+        const Vector::const_iterator& last,
+        const int dest_pe);
+};
+
+Vector::iterator Shmem::receive_first;
+Index Shmem::chunk_size = Shmem::default_chunk_size;
+vector<char> Shmem::message;
+
+// sz is size of one message, vector sizes never pass through it
+void ShmemReceiveElem(int /* from */, void* data, int sz)
+{
+    Index index;
+    memcpy(&index, data, sizeof(index));
+    const Index count = (sz - sizeof(index)) / sizeof(complexd);
+    memcpy(&*(Shmem::receive_first + index), (char*) data + sizeof(index),
+        count * sizeof(complexd));
+    #ifdef DEBUG
+    EventLog::Record(EventLog::shmem_receive, count, index);
+    #endif
+}
+
+int Shmem::HandlerNumber()
+{
+    return 1;
+}
+
+void Shmem::SetReceiveVector(const Vector::iterator& first)
+{
+    receive_first = first;
+    #ifdef DEBUG
+    EventLog::Record(EventLog::shmem_set_receive_vector);
+    #endif
+}
+
+void Shmem::SetChunkSize(const Index chunk_size)
+{
+    Shmem::chunk_size = chunk_size ? chunk_size : default_chunk_size;
+}
+
+void Shmem::SendVector(
+    const Vector::const_iterator& first,
+    const Vector::const_iterator& last,
+    const int dest_pe)
+{
+    #ifdef DEBUG
+    EventLog::Record(EventLog::shmem_send_begin);
+    #endif
+    const Index count = distance(first, last);
+    for (Index index = 0; index < count; index += chunk_size)
+    {
+        const Index n = min(chunk_size, count - index);
+        const Index size = sizeof(index) + n * sizeof(complexd);
+        message.resize(size);
+        memcpy(message.data(), &index, sizeof(index));
+        memcpy(message.data() + sizeof(index), &*(first + index),
+            n * sizeof(complexd));
+        #ifdef DEBUG
+        EventLog::Record(EventLog::shmem_send_message, n, index);
+        #endif
+        shmem_send(message.data(), HandlerNumber(), size, dest_pe);
+        Stats::SendAdd(size);
+    }
+    #ifdef DEBUG
+    EventLog::Record(EventLog::shmem_send_end);
+    #endif
+}
+
+/*
+    Values sent to the root of DoubleGather, each message holds offset of
+    its first value within the values of its sender followed by values.
+*/
+class Gather
+{
+    friend ShmemHandler ShmemReceiveGathered;
+    // values of each PE, filled on root only
+    static vector<vector<double> > received;
+    static const Index message_values = Index(1) << 16;
+    public:
+    static int HandlerNumber();
+    static vector<double> Run(const double* x, const Index count,
+        const int root);
+};
+
+vector<vector<double> > Gather::received;
+const Index Gather::message_values;
+
+void ShmemReceiveGathered(int from, void* data, int sz)
+{
+    Index offset;
+    memcpy(&offset, data, sizeof(offset));
+    const Index count = (sz - sizeof(offset)) / sizeof(double);
+    vector<double>& values = Gather::received[from];
+    if (values.size() < offset + count)
+    {
+        values.resize(offset + count);
+    }
+    memcpy(&values[offset], (char*) data + sizeof(offset),
+        count * sizeof(double));
+}
+
+int Gather::HandlerNumber()
+{
+    return 2;
+}
+
+// senders wait for root to clear its slots, messages land by next barrier
+vector<double> Gather::Run(const double* x, const Index count,
+    const int root)
+{
+    const int me = shmem_my_pe();
+    if (me == root)
+    {
+        received.assign(shmem_n_pes(), vector<double>());
+        received[me].assign(x, x + count);
+    }
+    shmem_barrier_all();
+
+    vector<char> message;
+    for (Index offset = 0; me != root && offset < count;
+        offset += message_values)
+    {
+        const Index n = min(message_values, count - offset);
+        message.resize(sizeof(offset) + n * sizeof(double));
+        memcpy(message.data(), &offset, sizeof(offset));
+        memcpy(message.data() + sizeof(offset), x + offset,
+            n * sizeof(double));
+        shmem_send(message.data(), HandlerNumber(), message.size(), root);
+    }
+    shmem_barrier_all();
+
+    vector<double> result;
+    for (auto& values: received)
+    {
+        result.insert(result.end(), values.begin(), values.end());
+    }
+    received.clear();
+    return result;
+}
+
+// collectives wait here for the last PE, not within the transfer
+static void WaitForAll()
+{
+    PhaseTimer timer(Stats::phase_wait);
+    shmem_barrier_all();
+}
+
+const bool Backend::exchange_needs_buffer = true;
+
+void Backend::Init(int* argc, char*** argv)
+{
+    shmem_init(argc, argv);
+    shmem_register_handler(ShmemReceiveElem, Shmem::HandlerNumber());
+    shmem_register_handler(ShmemReceiveGathered, Gather::HandlerNumber());
+
+    // PEs of a node are keyed by the characters of its host name
+    char hostname[256] = "";
+    gethostname(hostname, sizeof(hostname) - 1);
+    NodeShm::Init(vector<double>(hostname, hostname + strlen(hostname)));
+}
+
+void Backend::Finalize()
+{
+    StateMemory::ReleaseCache();
+    NodeShm::Finalize();
+    shmem_finalize();
+}
+
+// every process is a single PE
+int Backend::Run(const function<int()>& pe_main)
+{
+    return pe_main();
+}
+
+// launcher ends the other processes once one of them fails
+void Backend::Abort(const int exit_code)
+{
+    exit(exit_code);
+}
+
+int Backend::MyPe()
+{
+    return shmem_my_pe();
+}
+
+int Backend::NPes()
+{
+    return shmem_n_pes();
+}
+
+void Backend::BarrierAll()
+{
+    shmem_barrier_all();
+}
+
+void Backend::DoubleToAll(double* x, const Index count, const int root)
+{
+    Stats::BroadcastAdd(count * sizeof(double));
+    WaitForAll();
+    for (Index i = 0; i < count; i++)
+    {
+        shmem_double_toall(x + i, root);
+    }
+}
+
+void Backend::DoubleAllSum(double* x, const Index count)
+{
+    Stats::ReductionAdd(count * sizeof(double));
+    WaitForAll();
+    for (Index i = 0; i < count; i++)
+    {
+        shmem_double_allsum(x + i);
+    }
+}
+
+vector<double> Backend::DoubleGather(const double* x, const Index count,
+    const int root)
+{
+    return Gather::Run(x, count, root);
+}
+
+void Backend::ExchangeWithPartner(
+    const Vector::iterator& first,
+    const Vector::iterator& last,
+    const Vector::iterator& buffer,
+    const int partner_pe)
+{
+    Shmem::SetReceiveVector(buffer);
+
+    // same number of barriers on all paths, the first one makes sure
+    // partner is ready to receive before sending
+    if (first != last && NodeShm::SameNode(partner_pe))
+    {
+        if (NodeShm::Exchange(first, last, partner_pe, []()
+            {
+                PhaseTimer timer(Stats::phase_wait);
+                BarrierAll();
+            }))
+        {
+            return;
+        }
+    }
+    else
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        BarrierAll();
+    }
+
+    Shmem::SendVector(first, last, partner_pe);
+    BarrierAll();
+    copy(buffer, buffer + distance(first, last), first);
+}
+
+bool Backend::SetChunkSize(const Index chunk_size)
+{
+    Shmem::SetChunkSize(chunk_size);
+    return true;
+}
+
+double Backend::Time()
+{
+    return shmem_time();
+}
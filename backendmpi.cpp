@@ -0,0 +1,194 @@
+// C interface is enough, deprecated C++ bindings do not pass -Werror
+#define OMPI_SKIP_MPICXX
+#define MPICH_SKIP_MPICXX
+#include <mpi.h>
+#include <algorithm> // copy, min
+
+#include "backend.h"
+#include "nodeshm.h"
+#include "statememory.h"
+#include "stats.h"
+#include "timer.h"
+
+using std::copy;
+using std::min;
+
+/*
+    One process per PE. Partners on the same node exchange through shared
+    memory, others post non-blocking receive and send of the whole range.
+    Collectives are single MPI calls.
+*/
+namespace
+{
+    // MPI counts are int so long ranges go in several messages
+    const Index default_message_size = Index(1) << 26;
+    Index max_message_size = default_message_size;
+    // above tags of data messages, MPI guarantees at least 32767 tags
+    const int sync_tag = 32767;
+
+    // empty message both ways, returns once partner has entered
+    void PairSync(const int partner_pe)
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        MPI_Sendrecv(NULL, 0, MPI_CHAR, partner_pe, sync_tag,
+            NULL, 0, MPI_CHAR, partner_pe, sync_tag, MPI_COMM_WORLD,
+            MPI_STATUS_IGNORE);
+    }
+
+    // collectives wait here for the last PE, not within the transfer
+    void WaitForAll()
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+const bool Backend::exchange_needs_buffer = true;
+
+void Backend::Init(int* argc, char*** argv)
+{
+    MPI_Init(argc, argv);
+
+    // PEs of a node are keyed by their lowest rank
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+        MPI_INFO_NULL, &node_comm);
+    double leader = MyPe();
+    MPI_Bcast(&leader, 1, MPI_DOUBLE, 0, node_comm);
+    MPI_Comm_free(&node_comm);
+    NodeShm::Init(vector<double>(1, leader));
+}
+
+void Backend::Finalize()
+{
+    StateMemory::ReleaseCache();
+    NodeShm::Finalize();
+    MPI_Finalize();
+}
+
+// every process is a single PE
+int Backend::Run(const function<int()>& pe_main)
+{
+    return pe_main();
+}
+
+void Backend::Abort(const int exit_code)
+{
+    MPI_Abort(MPI_COMM_WORLD, exit_code);
+}
+
+int Backend::MyPe()
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
+
+int Backend::NPes()
+{
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+}
+
+void Backend::BarrierAll()
+{
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void Backend::DoubleToAll(double* x, const Index count, const int root)
+{
+    Stats::BroadcastAdd(count * sizeof(double));
+    WaitForAll();
+    MPI_Bcast(x, count, MPI_DOUBLE, root, MPI_COMM_WORLD);
+}
+
+void Backend::DoubleAllSum(double* x, const Index count)
+{
+    Stats::ReductionAdd(count * sizeof(double));
+    WaitForAll();
+    MPI_Allreduce(MPI_IN_PLACE, x, count, MPI_DOUBLE, MPI_SUM,
+        MPI_COMM_WORLD);
+}
+
+// counts are gathered first so that root knows where values go
+vector<double> Backend::DoubleGather(const double* x, const Index count,
+    const int root)
+{
+    const int pes = NPes();
+    const bool is_root = MyPe() == root;
+    const int n = count;
+    vector<int> counts(is_root ? pes : 0);
+    MPI_Gather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, root,
+        MPI_COMM_WORLD);
+    vector<int> offsets(counts.size());
+    int total = 0;
+    for (int pe = 0; is_root && pe < pes; pe++)
+    {
+        offsets[pe] = total;
+        total += counts[pe];
+    }
+    vector<double> result(total);
+    MPI_Gatherv(const_cast<double*>(x), n, MPI_DOUBLE, result.data(),
+        counts.data(), offsets.data(), MPI_DOUBLE, root, MPI_COMM_WORLD);
+    return result;
+}
+
+void Backend::ExchangeWithPartner(
+    const Vector::iterator& first,
+    const Vector::iterator& last,
+    const Vector::iterator& buffer,
+    const int partner_pe)
+{
+    const Index count = last - first;
+    if (count && NodeShm::SameNode(partner_pe) &&
+        NodeShm::Exchange(first, last, partner_pe, [partner_pe]()
+            {
+                PairSync(partner_pe);
+            }))
+    {
+        return;
+    }
+
+    /*
+        Receives are posted, then partner's arrival is awaited so that
+        time of a late partner is waiting, not transfer
+    */
+    vector<MPI_Request> requests;
+    for (Index offset = 0; offset < count; offset += max_message_size)
+    {
+        const int size = min(max_message_size, count - offset);
+        // messages of a pair do not overtake each other, tags may repeat
+        const int tag = (offset / max_message_size) % sync_tag;
+        requests.push_back(MPI_Request());
+        MPI_Irecv(&*(buffer + offset), size, MPI_CXX_DOUBLE_COMPLEX,
+            partner_pe, tag, MPI_COMM_WORLD, &requests.back());
+    }
+    if (count)
+    {
+        PairSync(partner_pe);
+    }
+    for (Index offset = 0; offset < count; offset += max_message_size)
+    {
+        const int size = min(max_message_size, count - offset);
+        const int tag = (offset / max_message_size) % sync_tag;
+        requests.push_back(MPI_Request());
+        MPI_Isend(&*(first + offset), size, MPI_CXX_DOUBLE_COMPLEX,
+            partner_pe, tag, MPI_COMM_WORLD, &requests.back());
+        Stats::SendAdd(size * sizeof(complexd));
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    copy(buffer, buffer + count, first);
+}
+
+bool Backend::SetChunkSize(const Index chunk_size)
+{
+    max_message_size = chunk_size ?
+        min(chunk_size, default_message_size) : default_message_size;
+    return true;
+}
+
+double Backend::Time()
+{
+    return MPI_Wtime();
+}
@@ -0,0 +1,222 @@
+#include <algorithm> // copy, max, swap_ranges
+#include <chrono> // steady_clock
+#include <condition_variable> // condition_variable
+#include <cstdlib> // getenv, _Exit
+#include <iostream> // std::cout, std::cerr
+#include <mutex> // mutex, unique_lock
+#include <thread> // thread
+
+#include "backend.h"
+#include "routines.h"
+#include "statememory.h"
+#include "stats.h"
+#include "timer.h"
+
+using std::cerr;
+using std::condition_variable;
+using std::cout;
+using std::copy;
+using std::max;
+using std::mutex;
+using std::swap_ranges;
+using std::thread;
+using std::unique_lock;
+
+namespace chrono = std::chrono;
+
+/*
+    All PEs are threads of one process. Collectives go through arrays
+    indexed by PE which are read between two barriers, partner exchange
+    swaps halves of the two vectors in place without any copy.
+*/
+namespace
+{
+    int pe_count = 1;
+    thread_local int my_pe = 0;
+
+    mutex barrier_mutex;
+    condition_variable barrier_released;
+    int barrier_waiting = 0;
+    unsigned barrier_generation = 0;
+
+    // values published by each PE for the current collective
+    vector<vector<double> > published_values;
+    vector<complexd*> published_ranges;
+
+    const chrono::steady_clock::time_point start_time =
+        chrono::steady_clock::now();
+}
+
+const bool Backend::exchange_needs_buffer = false;
+
+// number of PEs is given by environment variable PE_COUNT
+void Backend::Init(int* /* argc */, char*** /* argv */)
+{
+    const char* s = getenv("PE_COUNT");
+    pe_count = s ? string_to_number<int>(s) : thread::hardware_concurrency();
+    pe_count = max(pe_count, 1);
+    published_values.resize(pe_count);
+    published_ranges.resize(pe_count);
+}
+
+void Backend::Finalize()
+{
+    StateMemory::ReleaseCache();
+}
+
+int Backend::Run(const function<int()>& pe_main)
+{
+    vector<int> exit_codes(pe_count);
+    vector<thread> threads;
+    for (int pe = 0; pe < pe_count; pe++)
+    {
+        threads.push_back(thread([pe, &pe_main, &exit_codes]()
+            {
+                my_pe = pe;
+                exit_codes[pe] = pe_main();
+            }));
+    }
+
+    int result = 0;
+    for (int pe = 0; pe < pe_count; pe++)
+    {
+        threads[pe].join();
+        result = max(result, exit_codes[pe]);
+    }
+    return result;
+}
+
+/*
+    Other PEs may be blocked in a barrier, the process ends without
+    destroying what they use
+*/
+void Backend::Abort(const int exit_code)
+{
+    cout.flush();
+    cerr.flush();
+    _Exit(exit_code);
+}
+
+int Backend::MyPe()
+{
+    return my_pe;
+}
+
+int Backend::NPes()
+{
+    return pe_count;
+}
+
+void Backend::BarrierAll()
+{
+    unique_lock<mutex> lock(barrier_mutex);
+    const unsigned generation = barrier_generation;
+    barrier_waiting++;
+    if (barrier_waiting == pe_count)
+    {
+        barrier_waiting = 0;
+        barrier_generation++;
+        barrier_released.notify_all();
+    }
+    else
+    {
+        barrier_released.wait(lock, [generation]()
+            {
+                return generation != barrier_generation;
+            });
+    }
+}
+
+void Backend::DoubleToAll(double* x, const Index count, const int root)
+{
+    Stats::BroadcastAdd(count * sizeof(double));
+    if (my_pe == root)
+    {
+        published_values[root].assign(x, x + count);
+    }
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        BarrierAll();
+    }
+    if (my_pe != root)
+    {
+        const vector<double>& values = published_values[root];
+        copy(values.begin(), values.end(), x);
+    }
+    // root may publish again only after everyone has read
+    BarrierAll();
+}
+
+// every PE adds values in the same order so results are identical
+void Backend::DoubleAllSum(double* x, const Index count)
+{
+    Stats::ReductionAdd(count * sizeof(double));
+    published_values[my_pe].assign(x, x + count);
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        BarrierAll();
+    }
+    for (Index i = 0; i < count; i++)
+    {
+        x[i] = 0.0;
+        for (int pe = 0; pe < pe_count; pe++)
+        {
+            x[i] += published_values[pe][i];
+        }
+    }
+    BarrierAll();
+}
+
+vector<double> Backend::DoubleGather(const double* x, const Index count,
+    const int root)
+{
+    published_values[my_pe].assign(x, x + count);
+    BarrierAll();
+    vector<double> result;
+    for (int pe = 0; my_pe == root && pe < pe_count; pe++)
+    {
+        result.insert(result.end(), published_values[pe].begin(),
+            published_values[pe].end());
+    }
+    BarrierAll();
+    return result;
+}
+
+void Backend::ExchangeWithPartner(
+    const Vector::iterator& first,
+    const Vector::iterator& last,
+    const Vector::iterator& /* buffer */,
+    const int partner_pe)
+{
+    const Index count = last - first;
+    published_ranges[my_pe] = count ? &*first : NULL;
+    {
+        PhaseTimer timer(Stats::phase_wait);
+        BarrierAll();
+    }
+
+    // the lower PE of the pair swaps both ranges
+    if (count && my_pe < partner_pe)
+    {
+        swap_ranges(first, last, published_ranges[partner_pe]);
+    }
+    if (count)
+    {
+        Stats::SendAdd(count * sizeof(complexd));
+        Stats::IntraNodeDataCounterAdd(count * sizeof(complexd));
+    }
+    BarrierAll();
+}
+
+// ranges are swapped in place, there are no messages
+bool Backend::SetChunkSize(const Index /* chunk_size */)
+{
+    return false;
+}
+
+double Backend::Time()
+{
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() -
+        start_time;
+    return elapsed.count();
+}
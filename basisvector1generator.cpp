@@ -1,10 +1,8 @@
-#include <dislib.h>
-
 #include "basisvector1generator.h"
-#include "computationbase.h"
 
-BasisVector1Generator::BasisVector1Generator():
-    first_call(true)
+BasisVector1Generator::BasisVector1Generator(const bool owns_first):
+    first_call(true),
+    owns_first(owns_first)
 {
 }
 
@@ -16,7 +14,7 @@ complexd BasisVector1Generator::operator()()
     {
         first_call = false;
 
-        if (shmem_my_pe() == ComputationBase::master_rank)
+        if (owns_first)
         {
             x = complexd(1.0, 0.0);
         }
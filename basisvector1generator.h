@@ -6,8 +6,10 @@
 class BasisVector1Generator
 {
     bool first_call;
+    // whether this process holds first element of the vector
+    const bool owns_first;
     public:
-    BasisVector1Generator();
+    BasisVector1Generator(const bool owns_first);
     complexd operator()();
 };
 
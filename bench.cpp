@@ -0,0 +1,350 @@
+#include <algorithm> // generate, min, sort
+#include <cmath> // sqrt
+#include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
+#include <iostream> // std::cout, std::cerr
+#include <unistd.h> // getopt, optarg
+
+#include "bench.h"
+#include "applyoperator.h"
+#include "backend.h"
+#include "exchangecodec.h"
+#include "parser.h"
+#include "randomcomplexgenerator.h"
+#include "routines.h"
+#include "stats.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::generate;
+using std::min;
+using std::sort;
+using std::sqrt;
+
+Bench::Bench(const Args& args, const int repetition_count):
+    worker(args),
+    repetition_count(repetition_count)
+{
+
+}
+
+/*
+    Collective, every PE runs setup and run the same number of times.
+    Only run is timed.
+*/
+void Bench::Measure(const string& name, const Index parameter,
+    const Index elements, const double bytes,
+    const function<void()>& setup, const function<void()>& run)
+{
+    vector<double> seconds;
+    for (int i = 0; i < repetition_count; i++)
+    {
+        setup();
+        Backend::BarrierAll();
+        const double start = Backend::Time();
+        run();
+        seconds.push_back(Backend::Time() - start);
+    }
+    sort(seconds.begin(), seconds.end());
+    Result r = {name, parameter, elements, bytes, seconds.front(),
+        seconds[seconds.size() / 2]};
+    results.push_back(r);
+}
+
+// one kernel per local target qubit, from the largest stride down
+void Bench::BenchApplyOperator()
+{
+    const Index size = worker.params.WorkerVectorSize();
+    const bool idle = worker.params.Idle();
+    const complexd elem = 1.0 / sqrt(2.0);
+    Matrix U(2, Vector(2, elem));
+    U[1][1] = -elem;
+    const double bytes = 2.0 * size * sizeof(complexd);
+    for (int k = 1; k <= intlog2(size); k++)
+    {
+        Measure("apply_operator", size >> k, size, bytes, [](){},
+            [this, &U, k, idle]()
+            {
+                if (!idle)
+                {
+                    ::ApplyOperator(worker.psi, U, k);
+                }
+            });
+    }
+
+    const Index block_size = min(WorkerBase::BlockSize(), size);
+    const vector<Matrix> blocked(intlog2(block_size), U);
+    Measure("apply_operator_blocked", block_size, size, bytes, [](){},
+        [this, &blocked, block_size, idle]()
+        {
+            if (!idle)
+            {
+                ::ApplyOperatorBlocked(worker.psi, blocked, block_size);
+            }
+        });
+}
+
+void Bench::BenchScalarProduct()
+{
+    const Index size = worker.params.WorkerVectorSize();
+    Measure("scalar_product", 0, size, 2.0 * size * sizeof(complexd),
+        [](){},
+        [this]()
+        {
+            worker.ScalarProduct();
+        });
+}
+
+void Bench::BenchRandomGenerator()
+{
+    const Index size = worker.params.WorkerVectorSize();
+    Measure("random_complex_generator", 0, size, size * sizeof(complexd),
+        [](){},
+        [this]()
+        {
+            RandomComplexGenerator gen(MixSeed(1, Backend::MyPe()));
+            generate(worker.psi_next.begin(), worker.psi_next.end(), gen);
+        });
+}
+
+/*
+    Local norm, its sum over the group and scaling of a state generated
+    beforehand, as at the start of every iteration. Bytes are one read
+    for the norm, read and write for scaling and for the noiseless copy.
+*/
+void Bench::BenchNormalize()
+{
+    const Index size = worker.params.WorkerVectorSize();
+    Measure("normalize", 0, size, 5.0 * size * sizeof(complexd),
+        [this]()
+        {
+            worker.VectorInitRandomBegin(MixSeed(2, Backend::MyPe()));
+            worker.psi_next_ready.wait();
+        },
+        [this]()
+        {
+            const vector<double> local(1, worker.VectorInitRandomEnd());
+            worker.VectorNormalize(worker.GroupAllSum(local)[0]);
+        });
+}
+
+/*
+    Backend exchange of contiguous ranges of growing size between PEs
+    2k and 2k + 1, then SwapWithPartner for the first qubit if it is
+    global, with contiguous halves and with every other element.
+*/
+void Bench::BenchExchange()
+{
+    if (Backend::NPes() < 2)
+    {
+        return;
+    }
+
+    const Index half = worker.params.WorkerVectorSize() / 2;
+    const int partner = Backend::MyPe() ^ 1;
+    const bool paired = partner < Backend::NPes();
+    Vector data(half);
+    Vector buffer(Backend::exchange_needs_buffer ? half : 0);
+    Index count = 1024;
+    while (count < half)
+    {
+        Measure("exchange", count, count, 2.0 * count * sizeof(complexd),
+            [](){},
+            [&data, &buffer, count, paired, partner]()
+            {
+                Backend::ExchangeWithPartner(data.begin(),
+                    data.begin() + (paired ? count : 0), buffer.begin(),
+                    partner);
+            });
+        count *= 4;
+    }
+    Measure("exchange", half, half, 2.0 * half * sizeof(complexd), [](){},
+        [&data, &buffer, half, paired, partner]()
+        {
+            Backend::ExchangeWithPartner(data.begin(),
+                data.begin() + (paired ? half : 0), buffer.begin(),
+                partner);
+        });
+
+    if (worker.params.GroupSize() < 2)
+    {
+        return;
+    }
+    const WorkerBase::QubitPlace place = worker.Place(1);
+    for (Index pivot: {half, Index(1)})
+    {
+        Measure("swap_with_partner", pivot, half,
+            2.0 * half * sizeof(complexd), [](){},
+            [this, &place, pivot]()
+            {
+                worker.SwapWithPartner(place.partner_rank, place.value,
+                    pivot, 0, true);
+            });
+    }
+}
+
+// encoding and decoding of a half vector in each format but raw
+void Bench::BenchCodec()
+{
+    // idle PEs have nothing to encode
+    const Index half = worker.psi.size() / 2;
+    const double bytes = half * sizeof(complexd);
+    Vector encoded;
+    Index encoded_size = 0;
+    for (int f = ExchangeCodec::format_float; f < ExchangeCodec::format_count;
+        f++)
+    {
+        const ExchangeCodec::Format format = ExchangeCodec::Format(f);
+        const string name = ExchangeCodec::FormatName(format);
+        ExchangeCodec::SetFormat(format);
+        Measure("encode_" + name, 0, half, bytes, [](){},
+            [this, half, &encoded, &encoded_size]()
+            {
+                encoded_size = ExchangeCodec::Encode(worker.psi.begin(),
+                    half, encoded);
+            });
+        Measure("decode_" + name, 0, half, bytes, [](){},
+            [this, half, &encoded, &encoded_size]()
+            {
+                ExchangeCodec::Decode(encoded.begin(), encoded_size, half,
+                    worker.psi_next.begin());
+            });
+    }
+    ExchangeCodec::SetFormat(ExchangeCodec::format_raw);
+}
+
+void Bench::Run()
+{
+    RandomComplexGenerator gen(MixSeed(0, Backend::MyPe()));
+    generate(worker.psi.begin(), worker.psi.end(), gen);
+    worker.psi_noiseless = worker.psi;
+    worker.psi_next.resize(worker.psi.size());
+
+    BenchApplyOperator();
+    BenchScalarProduct();
+    BenchRandomGenerator();
+    BenchNormalize();
+    BenchExchange();
+    BenchCodec();
+}
+
+void Bench::WriteCsv(ostream& os) const
+{
+    os << "benchmark,parameter,qubits,pes,elements,bytes,seconds_min,"
+        "seconds_median,gb_per_second" << endl;
+    for (auto& r: results)
+    {
+        os << r.name << "," << r.parameter << ","
+            << worker.args.QubitCount() << "," << Backend::NPes() << ","
+            << r.elements << "," << r.bytes << "," << r.seconds_min << ","
+            << r.seconds_median << "," << r.bytes / r.seconds_min / 1e9
+            << endl;
+    }
+}
+
+void Bench::WriteJson(ostream& os) const
+{
+    os << "{\"qubits\": " << worker.args.QubitCount()
+        << ", \"pes\": " << Backend::NPes()
+        << ", \"repetitions\": " << repetition_count
+        << ", \"results\": [" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        os << "  {\"benchmark\": \"" << r.name << "\""
+            << ", \"parameter\": " << r.parameter
+            << ", \"elements\": " << r.elements
+            << ", \"bytes\": " << r.bytes
+            << ", \"seconds_min\": " << r.seconds_min
+            << ", \"seconds_median\": " << r.seconds_median
+            << ", \"gb_per_second\": " << r.bytes / r.seconds_min / 1e9
+            << "}" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    os << "]}" << endl;
+}
+
+static void PrintUsage()
+{
+    cout << "Usage: fidelity-bench [-n qubit_count] [-r repetition_count] "
+        "[-f csv | json]" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    Backend::Init(&argc, &argv);
+    const bool master = Backend::MyPe() == ComputationBase::master_rank;
+
+    string qubit_count = "20";
+    int repetition_count = 5;
+    string format = "csv";
+    int c;
+    while ((c = getopt(argc, argv, "n:r:f:")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                qubit_count = optarg;
+                break;
+            case 'r':
+                repetition_count = string_to_number<int>(optarg);
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            default:
+                if (master)
+                {
+                    PrintUsage();
+                }
+                Backend::Finalize();
+                return EXIT_FAILURE;
+        }
+    }
+
+    // worker state is set up by the same parser as for the simulation
+    vector<string> options = {"fidelity-bench", "-n", qubit_count};
+    vector<char*> parser_argv;
+    for (auto& s: options)
+    {
+        parser_argv.push_back(&s[0]);
+    }
+    parser_argv.push_back(NULL);
+    Parser parser(parser_argv.size() - 1, parser_argv.data());
+    const Args args = parser.Parse();
+
+    const Index vector_size = Index(1) << args.QubitCount();
+    if (repetition_count < 1 || (format != "csv" && format != "json") ||
+        Index(ComputationParams::GroupSize(args)) * 2 > vector_size)
+    {
+        if (master)
+        {
+            cerr << "Need positive repetition count, csv or json format "
+                "and at least two elements per process" << endl;
+            PrintUsage();
+        }
+        Backend::Finalize();
+        return EXIT_FAILURE;
+    }
+
+    const int exit_code = Backend::Run([&args, repetition_count, &format]()
+        {
+            // exchange partner counters are sized here
+            Stats::ResetCounters();
+            Bench bench(args, repetition_count);
+            bench.Run();
+            if (Backend::MyPe() == ComputationBase::master_rank)
+            {
+                if (format == "json")
+                {
+                    bench.WriteJson(cout);
+                }
+                else
+                {
+                    bench.WriteCsv(cout);
+                }
+            }
+            return EXIT_SUCCESS;
+        });
+    Backend::Finalize();
+    return exit_code;
+}
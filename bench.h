@@ -0,0 +1,54 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional> // function
+#include <ostream>
+#include <string>
+
+#include "workerbase.h"
+
+using std::function;
+using std::ostream;
+using std::string;
+
+/*
+    Microbenchmarks of the kernels and exchanges of WorkerBase, built by
+    `make bench` as a separate executable. Each benchmark is run a number
+    of times after a barrier and times of the master are reported, one
+    row per benchmark and parameter in a fixed order so that outputs of
+    two builds may be diffed. With BACKEND=threads all PEs are threads of
+    one process, exchanges then need no cluster.
+*/
+class Bench
+{
+    struct Result
+    {
+        string name;
+        // stride, block size or element count depending on benchmark
+        Index parameter;
+        Index elements;
+        double bytes;
+        double seconds_min;
+        double seconds_median;
+    };
+    WorkerBase worker;
+    const int repetition_count;
+    vector<Result> results;
+    void Measure(const string& name, const Index parameter,
+        const Index elements, const double bytes,
+        const function<void()>& setup, const function<void()>& run);
+    void BenchApplyOperator();
+    void BenchScalarProduct();
+    void BenchRandomGenerator();
+    void BenchNormalize();
+    void BenchExchange();
+    void BenchCodec();
+    public:
+    Bench(const Args& args, const int repetition_count);
+    // collective
+    void Run();
+    void WriteCsv(ostream& os) const;
+    void WriteJson(ostream& os) const;
+};
+
+#endif
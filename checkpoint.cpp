@@ -0,0 +1,133 @@
+#include <cstdio> // fopen, fwrite, rename
+#include <cstring> // memcpy, memcmp
+#include <fcntl.h> // open
+#include <fstream>
+#include <sstream> // ostringstream
+#include <unistd.h> // fsync, close
+
+#include "checkpoint.h"
+#include "backend.h"
+
+using std::async;
+using std::ifstream;
+using std::launch;
+using std::ofstream;
+using std::ostringstream;
+
+static const char checkpoint_magic[8] = {'F', 'I', 'D', 'C', 'K', 'P', 'T',
+    '\0'};
+static const uint32_t checkpoint_version = 1;
+
+Checkpoint::Error::Error(const string& msg):
+    runtime_error(msg)
+{
+
+}
+
+Checkpoint::Checkpoint(const string& prefix)
+{
+    ostringstream oss;
+    oss << prefix << "." << Backend::MyPe();
+    filename = oss.str();
+    previous_filename = filename + ".prev";
+}
+
+Checkpoint::Header Checkpoint::MakeHeader(const int qubit_count,
+    const int round, const unsigned seed)
+{
+    Header header;
+    memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = checkpoint_version;
+    header.qubit_count = qubit_count;
+    header.pe_count = Backend::NPes();
+    header.pe = Backend::MyPe();
+    header.round = round;
+    header.seed = seed;
+    header.stats_count = 0;
+    return header;
+}
+
+/*
+    Data is written to temporary file and synced to disk. The checkpoint
+    it replaces becomes the previous one, so that a crash during write
+    leaves two intact checkpoints and PEs behind by one write can still
+    agree on a round.
+*/
+void Checkpoint::WriteFile(const string& filename,
+    const string& previous_filename, const Header& header,
+    const vector<RunningStats>& stats)
+{
+    const string tmp_filename = filename + ".tmp";
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if (!f)
+    {
+        return; // previous checkpoint is kept
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (!stats.empty())
+    {
+        ok = ok && fwrite(&stats[0], sizeof(RunningStats), stats.size(), f)
+            == stats.size();
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+    {
+        return;
+    }
+    rename(filename.c_str(), previous_filename.c_str());
+    rename(tmp_filename.c_str(), filename.c_str());
+
+    // renames are durable once the directory is synced
+    const size_t slash = filename.find_last_of('/');
+    const string dir = slash == string::npos ? "." :
+        filename.substr(0, slash + 1);
+    const int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+void Checkpoint::Write(const Header& header, const vector<RunningStats>& stats)
+{
+    // at most one write is in flight
+    if (written.valid())
+    {
+        written.get();
+    }
+
+    Header h = header;
+    h.stats_count = stats.size();
+    written = async(launch::async, WriteFile, filename, previous_filename, h,
+        stats);
+}
+
+void Checkpoint::Read(const bool previous, Header& header,
+    vector<RunningStats>& stats) const
+{
+    const string& name = previous ? previous_filename : filename;
+    ifstream fs(name.c_str(), ifstream::binary);
+    if (!fs)
+    {
+        throw Error("Cannot open checkpoint " + name);
+    }
+
+    fs.read((char*) &header, sizeof(header));
+    if (!fs || memcmp(header.magic, checkpoint_magic, sizeof(header.magic))
+        || header.version != checkpoint_version)
+    {
+        throw Error("Not a checkpoint file " + name);
+    }
+
+    stats.resize(header.stats_count);
+    if (!stats.empty())
+    {
+        fs.read((char*) &stats[0], stats.size() * sizeof(RunningStats));
+    }
+    if (!fs)
+    {
+        throw Error("Checkpoint " + name + " is truncated");
+    }
+}
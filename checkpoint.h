@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint> // int32_t, int64_t, uint32_t
+#include <future> // future
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+#include "runningstats.h"
+
+using std::future;
+using std::int32_t;
+using std::int64_t;
+using std::runtime_error;
+using std::string;
+using std::uint32_t;
+using std::vector;
+
+/*
+    Per-process checkpoint file: fixed size header followed by statistics
+    of 1 - fidelity (written by master only). Checkpoints are taken
+    between rounds, states of the next round are regenerated from seed.
+    The checkpoint before the newest one is kept in a .prev file.
+*/
+class Checkpoint
+{
+    public:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t qubit_count;
+        int32_t pe_count;
+        int32_t pe;
+        int64_t round; // first round not yet computed
+        uint32_t seed;
+        uint32_t stats_count;
+    };
+
+    class Error: public runtime_error
+    {
+        public:
+        Error(const string& msg);
+    };
+
+    private:
+    string filename;
+    string previous_filename;
+    future<void> written;
+    static void WriteFile(const string& filename,
+        const string& previous_filename, const Header& header,
+        const vector<RunningStats>& stats);
+
+    public:
+    Checkpoint(const string& prefix);
+    // returns immediately, file is written in background
+    void Write(const Header& header, const vector<RunningStats>& stats);
+    // newest checkpoint or, if previous is set, the one before it
+    void Read(const bool previous, Header& header,
+        vector<RunningStats>& stats) const;
+    static Header MakeHeader(const int qubit_count, const int round,
+        const unsigned seed);
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include <cmath> // sqrt, cos, sin
+#include <fstream> // ifstream
+#include <sstream> // ostringstream, istringstream
+
+#include "circuit.h"
+#include "parser.h"
+#include "routines.h"
+
+using std::cos;
+using std::getline;
+using std::ifstream;
+using std::istringstream;
+using std::make_pair;
+using std::ostringstream;
+using std::sin;
+using std::sqrt;
+
+Circuit::Circuit():
+    qubit_count(0),
+    layer_count(0)
+{
+
+}
+
+Circuit Circuit::HadamardLayer(const int qubit_count)
+{
+    Circuit result;
+    result.qubit_count = qubit_count;
+    result.layer_count = 1;
+    for (int q = 1; q <= qubit_count; q++)
+    {
+        Gate g = {q, 0, false, GateMatrix("h")};
+        result.gates.push_back(g);
+    }
+    return result;
+}
+
+// returns empty matrix for unknown name
+Matrix Circuit::GateMatrix(const string& name)
+{
+    const complexd i(0.0, 1.0);
+    Matrix m(2, Vector(2));
+    const auto paren = name.find('(');
+    if (paren != string::npos)
+    {
+        if (name[name.size() - 1] != ')')
+        {
+            return Matrix();
+        }
+        const string gate = name.substr(0, paren);
+        const double a = string_to_number<double>(
+            name.substr(paren + 1, name.size() - paren - 2));
+        const double c = cos(a / 2);
+        const double s = sin(a / 2);
+        if (gate == "rx")
+        {
+            m[0][0] = c;
+            m[0][1] = -i * s;
+            m[1][0] = -i * s;
+            m[1][1] = c;
+        }
+        else if (gate == "ry")
+        {
+            m[0][0] = c;
+            m[0][1] = -s;
+            m[1][0] = s;
+            m[1][1] = c;
+        }
+        else if (gate == "rz")
+        {
+            m[0][0] = complexd(c, -s);
+            m[1][1] = complexd(c, s);
+        }
+        else
+        {
+            return Matrix();
+        }
+        return m;
+    }
+
+    if (name == "i")
+    {
+        m[0][0] = 1.0;
+        m[1][1] = 1.0;
+    }
+    else if (name == "h")
+    {
+        const complexd elem = 1.0 / sqrt(2.0);
+        m[0][0] = elem;
+        m[0][1] = elem;
+        m[1][0] = elem;
+        m[1][1] = -1.0 * elem;
+    }
+    else if (name == "x")
+    {
+        m[0][1] = 1.0;
+        m[1][0] = 1.0;
+    }
+    else if (name == "y")
+    {
+        m[0][1] = -i;
+        m[1][0] = i;
+    }
+    else if (name == "z")
+    {
+        m[0][0] = 1.0;
+        m[1][1] = -1.0;
+    }
+    else if (name == "s")
+    {
+        m[0][0] = 1.0;
+        m[1][1] = i;
+    }
+    else if (name == "t")
+    {
+        m[0][0] = 1.0;
+        m[1][1] = complexd(1.0, 1.0) / sqrt(2.0);
+    }
+    else
+    {
+        return Matrix();
+    }
+    return m;
+}
+
+/*
+    4x4 matrix in basis |first second>, returns empty matrix for unknown
+    name. Controlled gates are not listed, they keep their 2x2 matrix.
+*/
+Matrix Circuit::TwoQubitGateMatrix(const string& name)
+{
+    const complexd i(0.0, 1.0);
+    Matrix m(4, Vector(4));
+    m[0][0] = 1.0;
+    m[3][3] = 1.0;
+    if (name == "swap")
+    {
+        m[1][2] = 1.0;
+        m[2][1] = 1.0;
+    }
+    else if (name == "iswap")
+    {
+        m[1][2] = i;
+        m[2][1] = i;
+    }
+    else
+    {
+        return Matrix();
+    }
+    return m;
+}
+
+vector<int> Circuit::ParseQubits(const string& s, const int qubit_count)
+{
+    vector<int> result;
+    if (s == "*")
+    {
+        for (int q = 1; q <= qubit_count; q++)
+        {
+            result.push_back(q);
+        }
+        return result;
+    }
+
+    istringstream iss(s);
+    string token;
+    while (getline(iss, token, ','))
+    {
+        const auto dash = token.find('-');
+        const int first = string_to_number<int>(token.substr(0, dash));
+        const int last = (dash == string::npos) ? first :
+            string_to_number<int>(token.substr(dash + 1));
+        if (first < 1 || last > qubit_count || last < first)
+        {
+            throw Parser::ParseError("Qubits `" + token +
+                "' out of range");
+        }
+        for (int q = first; q <= last; q++)
+        {
+            result.push_back(q);
+        }
+    }
+    return result;
+}
+
+// pairs are written as first:second
+vector<pair<int, int> > Circuit::ParseQubitPairs(const string& s,
+    const int qubit_count)
+{
+    vector<pair<int, int> > result;
+    istringstream iss(s);
+    string token;
+    while (getline(iss, token, ','))
+    {
+        const auto colon = token.find(':');
+        if (colon == string::npos)
+        {
+            throw Parser::ParseError("Qubit pair `" + token +
+                "' has no colon");
+        }
+        const int first = string_to_number<int>(token.substr(0, colon));
+        const int second = string_to_number<int>(token.substr(colon + 1));
+        if (first < 1 || first > qubit_count || second < 1 ||
+            second > qubit_count || first == second)
+        {
+            throw Parser::ParseError("Qubit pair `" + token +
+                "' out of range");
+        }
+        result.push_back(make_pair(first, second));
+    }
+    return result;
+}
+
+Circuit Circuit::Read(const string& filename, const int qubit_count)
+{
+    ifstream fs(filename.c_str());
+    if (!fs)
+    {
+        throw Parser::ParseError("Cannot open circuit file " + filename);
+    }
+
+    Circuit result;
+    result.qubit_count = qubit_count;
+    string line;
+    int line_number = 0;
+    while (getline(fs, line))
+    {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        istringstream iss(line);
+        vector<bool> used(qubit_count + 1, false);
+        string name;
+        string qubits;
+        bool empty = true;
+        while (iss >> name)
+        {
+            ostringstream where;
+            where << filename << ":" << line_number << ": ";
+            Matrix U = GateMatrix(name);
+            bool controlled = false;
+            if (U.empty() && name[0] == 'c')
+            {
+                U = GateMatrix(name.substr(1));
+                controlled = !U.empty();
+            }
+            const bool two_qubit = controlled || U.empty();
+            if (U.empty())
+            {
+                U = TwoQubitGateMatrix(name);
+            }
+            if (U.empty())
+            {
+                throw Parser::ParseError(where.str() + "unknown gate `" +
+                    name + "'");
+            }
+            if (!(iss >> qubits))
+            {
+                throw Parser::ParseError(where.str() + "gate `" + name +
+                    "' has no qubits");
+            }
+
+            // control comes first in the file, it is Gate::second
+            vector<pair<int, int> > targets;
+            if (two_qubit)
+            {
+                for (auto p: ParseQubitPairs(qubits, qubit_count))
+                {
+                    targets.push_back(controlled ?
+                        make_pair(p.second, p.first) : p);
+                }
+            }
+            else
+            {
+                for (auto q: ParseQubits(qubits, qubit_count))
+                {
+                    targets.push_back(make_pair(q, 0));
+                }
+            }
+
+            for (auto& t: targets)
+            {
+                if (used[t.first] || used[t.second])
+                {
+                    throw Parser::ParseError(where.str() +
+                        "qubit used twice in a layer");
+                }
+                used[t.first] = true;
+                used[t.second] = t.second != 0;
+                Gate g = {t.first, t.second, controlled, U};
+                result.gates.push_back(g);
+            }
+            empty = false;
+        }
+        if (!empty)
+        {
+            result.layer_count++;
+        }
+    }
+    return result;
+}
+
+int Circuit::GateCount() const
+{
+    return gates.size();
+}
+
+int Circuit::LayerCount() const
+{
+    return layer_count;
+}
+
+bool Circuit::HasTwoQubitGates() const
+{
+    for (auto& g: gates)
+    {
+        if (g.second)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// two-qubit gates other than controlled ones
+bool Circuit::HasFullTwoQubitGates() const
+{
+    for (auto& g: gates)
+    {
+        if (g.second && !g.controlled)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+vector<Circuit::Step> Circuit::Fuse(const Matrix& noise) const
+{
+    return Fuse(vector<Matrix>(qubit_count, noise));
+}
+
+vector<Circuit::Step> Circuit::Fuse(const vector<Matrix>& noise) const
+{
+    vector<Step> result;
+    vector<Matrix> fused(qubit_count);
+    /*
+        Multiplies gate of qubit q, or noise alone, into fused gates. Noise
+        which is exactly identity, as with epsilon * xi == 0, is left out
+        so that it adds no pass over the state.
+    */
+    const auto add = [&fused, &noise](const int q, const Matrix& U)
+        {
+            Matrix& f = fused[q - 1];
+            const Matrix& n = noise[q - 1];
+            const bool identity = n[0][0] == 1.0 && n[0][1] == 0.0 &&
+                n[1][0] == 0.0 && n[1][1] == 1.0;
+            if (identity && U.empty())
+            {
+                return;
+            }
+            const Matrix noisy = identity ? U :
+                U.empty() ? n : MatrixMultiply(U, n);
+            f = f.empty() ? noisy : MatrixMultiply(noisy, f);
+        };
+
+    for (auto& g: gates)
+    {
+        if (!g.second)
+        {
+            add(g.qubit, g.U);
+            continue;
+        }
+
+        add(g.qubit, Matrix());
+        add(g.second, Matrix());
+        Step step = {vector<Matrix>(qubit_count), g.qubit, g.second,
+            g.controlled, g.U};
+        step.single[g.qubit - 1].swap(fused[g.qubit - 1]);
+        step.single[g.second - 1].swap(fused[g.second - 1]);
+        result.push_back(step);
+    }
+
+    Step last = {fused, 0, 0, false, Matrix()};
+    result.push_back(last);
+    return result;
+}
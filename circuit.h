@@ -0,0 +1,88 @@
+#ifndef CIRCUIT_H
+#define CIRCUIT_H
+
+#include <string>
+#include <utility> // pair
+
+#include "typedefs.h"
+
+using std::pair;
+using std::string;
+
+/*
+    Sequence of gates applied to the state, qubits are numbered from 1
+    (most significant) to qubit_count. Circuit file has one layer per
+    line, a layer is a list of gate names each followed by the qubits it
+    acts on:
+
+        # comment
+        h *
+        rx(0.5) 1,3 z 2 t 4-6
+        cx 1:2,3:4 swap 5:6
+
+    Qubits of single-qubit gates are given as comma separated numbers and
+    ranges, '*' means all qubits. Two-qubit gates take comma separated
+    pairs, controlled gates list control first. A qubit may be used once
+    per layer.
+
+    Single-qubit gates are i, h, x, y, z, s, t and rotations rx(a),
+    ry(a), rz(a) by angle a in radians. Controlled gates are c followed
+    by a single-qubit gate name, e. g. cx, cz, crz(a). Other two-qubit
+    gates are swap and iswap.
+*/
+class Circuit
+{
+    struct Gate
+    {
+        int qubit;
+        // 0 for single-qubit gates
+        int second;
+        // second qubit is control, U is 2x2 acting on qubit
+        bool controlled;
+        Matrix U;
+    };
+    int qubit_count;
+    vector<Gate> gates;
+    int layer_count;
+    static Matrix GateMatrix(const string& name);
+    static Matrix TwoQubitGateMatrix(const string& name);
+    static vector<int> ParseQubits(const string& s, const int qubit_count);
+    static vector<pair<int, int> > ParseQubitPairs(const string& s,
+        const int qubit_count);
+    public:
+    /*
+        Fused single-qubit gates of each qubit, element q - 1 for qubit q,
+        empty matrix means no gate. Followed by a two-qubit gate if qubit
+        is not zero: controlled U on qubit with control second, or 4x4 U
+        on |qubit second>.
+    */
+    struct Step
+    {
+        vector<Matrix> single;
+        int qubit;
+        int second;
+        bool controlled;
+        Matrix U;
+    };
+    Circuit();
+    // hadamard gate on every qubit, the default workload
+    static Circuit HadamardLayer(const int qubit_count);
+    // throws Parser::ParseError
+    static Circuit Read(const string& filename, const int qubit_count);
+    int GateCount() const;
+    int LayerCount() const;
+    bool HasTwoQubitGates() const;
+    bool HasFullTwoQubitGates() const;
+    /*
+        Fuses consecutive single-qubit gates of each qubit into one
+        matrix, noise[q - 1] is applied to qubit q of a gate right before
+        it.
+        Gates on different qubits commute so fused gates of a qubit are
+        flushed only by a two-qubit gate on that qubit and at the end.
+    */
+    vector<Step> Fuse(const vector<Matrix>& noise) const;
+    // the same noise on every qubit
+    vector<Step> Fuse(const Matrix& noise) const;
+};
+
+#endif
@@ -1,19 +1,147 @@
+
+#include <algorithm> // max, min
+
 #include "computationbase.h"
+#include "backend.h"
+#include "routines.h"
+#include "timer.h"
+
+using std::max;
+using std::min;
+
+thread_local unsigned ComputationBase::seed;
 
 ComputationBase::ComputationBase(const Args& args):
     args(args),
-    params(args.QubitCount())
+    checkpoint(args.CheckpointFlag() ? args.CheckpointPrefix() : "")
 {
 }
 
-Matrix ComputationBase::HadamardMatrix()
+// rotation by angle theta
+Matrix ComputationBase::NoiseMatrix(const double theta)
 {
+    const complexd c = cos(theta);
+    const complexd s = sin(theta);
     Matrix m(2, Vector(2));
-    const complexd elem = 1.0 / sqrt(2.0);
-    m[0][0] = elem;
-    m[0][1] = elem;
-    m[1][0] = elem;
-    m[1][1] = -1.0 * elem;
+
+    m[0][0] = c;
+    m[0][1] = s;
+    m[1][0] = -1.0 * s;
+    m[1][1] = c;
 
     return m;
 }
+
+int ComputationBase::NoiseCount() const
+{
+    return args.PerQubitNoiseFlag() ? args.QubitCount() : 1;
+}
+
+vector<Matrix> ComputationBase::NoiseMatrices(const double epsilon,
+    const vector<double>& xi) const
+{
+    vector<Matrix> result;
+    for (int q = 0; q < args.QubitCount(); q++)
+    {
+        result.push_back(NoiseMatrix(epsilon * xi[xi.size() > 1 ? q : 0]));
+    }
+    return result;
+}
+
+// counterpart of Master::BroadcastStopFlag
+bool ComputationBase::ReceiveStopFlag()
+{
+    PhaseTimer timer(Stats::phase_broadcast);
+    double x;
+    Backend::DoubleToAll(&x, 1, master_rank);
+    return x != 0.0;
+}
+
+void ComputationBase::SetSeed(const unsigned seed)
+{
+    ComputationBase::seed = seed;
+}
+
+/*
+    Seeds depend on round only, so a restarted run regenerates exactly the
+    states and noise the interrupted run would have used
+*/
+unsigned ComputationBase::RoundSeed(const int round, const SeedStream stream)
+{
+    return MixSeed(MixSeed(seed, round), stream);
+}
+
+/*
+    Returns first round to compute. Checkpoints are written in background
+    so after a crash PEs may hold different rounds: master takes the
+    newest round of the PE furthest behind, every PE must have kept it as
+    its newest or previous checkpoint. Collective, all PEs fail alike. On
+    restart the seed and statistics (master only) are taken from that
+    checkpoint of this process.
+*/
+int ComputationBase::CheckpointRestore(vector<RunningStats>& stats)
+{
+    if (!args.RestartFlag())
+    {
+        return 0;
+    }
+
+    // newest and previous checkpoint, round -1 if missing or not matching
+    Checkpoint::Header headers[2];
+    vector<RunningStats> saved_stats[2];
+    double rounds[2] = {-1.0, -1.0};
+    for (int k = 0; k < 2; k++)
+    {
+        try
+        {
+            checkpoint.Read(k == 1, headers[k], saved_stats[k]);
+        }
+        catch (Checkpoint::Error&)
+        {
+            continue;
+        }
+        if (headers[k].qubit_count == args.QubitCount() &&
+            headers[k].pe_count == Backend::NPes() &&
+            headers[k].pe == Backend::MyPe() &&
+            saved_stats[k].size() == stats.size())
+        {
+            rounds[k] = headers[k].round;
+        }
+    }
+
+    const vector<double> all = Backend::DoubleGather(rounds, 2, master_rank);
+    double common = all.empty() ? 0.0 : max(all[0], all[1]);
+    for (Index pe = 0; 2 * pe < all.size(); pe++)
+    {
+        common = min(common, max(all[2 * pe], all[2 * pe + 1]));
+    }
+    for (Index pe = 0; 2 * pe < all.size(); pe++)
+    {
+        if (all[2 * pe] != common && all[2 * pe + 1] != common)
+        {
+            common = -1.0;
+        }
+    }
+    Backend::DoubleToAll(&common, 1, master_rank);
+    if (common < 0.0)
+    {
+        throw Checkpoint::Error("No checkpoint round is kept by all "
+            "processes with matching parameters");
+    }
+
+    const int k = rounds[0] == common ? 0 : 1;
+    seed = headers[k].seed;
+    stats = saved_stats[k];
+    return headers[k].round;
+}
+
+// round is the first round not yet computed
+void ComputationBase::CheckpointSave(const int round,
+    const vector<RunningStats>& stats)
+{
+    if (args.CheckpointFlag() && round % args.CheckpointInterval() == 0)
+    {
+        checkpoint.Write(Checkpoint::MakeHeader(args.QubitCount(), round,
+            seed), stats);
+    }
+}
@@ -1,20 +1,40 @@
 #ifndef COMPUTATIONBASE_H
 #define COMPUTATIONBASE_H
 
+#include "checkpoint.h"
 #include "parser.h"
-#include "computationparams.h"
+#include "runningstats.h"
 #include "typedefs.h"
 
 class ComputationBase
 {
     protected:
     Args args;
-    ComputationParams params;
-    Matrix U;
-    static Matrix HadamardMatrix();
+    // fused gates, see Circuit::Fuse
+    vector<Circuit::Step> steps;
+    Checkpoint checkpoint;
+    // base of all random seeds of this PE
+    static thread_local unsigned seed;
+    // random numbers of each round come from separate streams
+    enum SeedStream
+    {
+        state_stream,
+        noise_stream
+    };
+    static unsigned RoundSeed(const int round, const SeedStream stream);
+    int CheckpointRestore(vector<RunningStats>& stats);
+    void CheckpointSave(const int round, const vector<RunningStats>& stats);
+    static Matrix NoiseMatrix(const double theta);
+    // noise samples per iteration, one per qubit or one shared
+    int NoiseCount() const;
+    // noise of each qubit for samples xi scaled by epsilon
+    vector<Matrix> NoiseMatrices(const double epsilon,
+        const vector<double>& xi) const;
+    static bool ReceiveStopFlag();
     ComputationBase(const Args& args);
     public:
     static const int master_rank = 0;
+    static void SetSeed(const unsigned seed);
 };
 
 #endif
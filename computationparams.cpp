@@ -1,25 +1,98 @@
-#include <dislib.h>
+#include <algorithm> // find, stable_sort
+#include <limits> // numeric_limits
 
 #ifdef DEBUG
 #include "debug.h"
+#include "eventlog.h"
 #endif
 
 #include "computationparams.h"
+#include "backend.h"
+#include "nodeshm.h"
 #include "routines.h"
 
+using std::find;
 using std::min;
+using std::numeric_limits;
+using std::stable_sort;
 
-ComputationParams::ComputationParams(const int qubit_count):
-    qubit_count(qubit_count),
-    target_qubit(-1)
+static_assert(numeric_limits<Index>::digits >= 64,
+    "Index must be 64-bit to address vectors of more than 31 qubits");
+
+// keeps byte size of all vectors of a single process within Index
+const int ComputationParams::max_qubit_count =
+    numeric_limits<Index>::digits - 7;
+
+ComputationParams::ComputationParams(const Args& args):
+    qubit_count(args.QubitCount()),
+    slot_pe(SlotPes()),
+    target_qubit(-1),
+    target_qubit_value(0),
+    partner_rank(-1)
 {
-    const Index vector_size      = 1L << qubit_count;
-    worker_vector_size           = vector_size / shmem_n_pes();
+    const int slot               = find(slot_pe.begin(), slot_pe.end(),
+        Backend::MyPe()) - slot_pe.begin();
+    group_size                   = GroupSize(args);
+    group_count                  = Backend::NPes() / group_size;
+    group                        = slot / group_size;
+    group_rank                   = slot % group_size;
+    idle                         = group >= group_count;
+
+    const Index vector_size      = Index(1) << qubit_count;
+    worker_vector_size           = vector_size / group_size;
     const int worker_qubit_count = intlog2(worker_vector_size);
     global_qubit_count           = qubit_count - worker_qubit_count;
     most_significant_local_qubit = global_qubit_count + 1;
 }
 
+/*
+    Returns group size given by user or the largest power of two not
+    exceeding number of processes. When number of processes is not a
+    power of two, half of that is used so that more processes get work,
+    e. g. 48 processes make three groups of 16. Group size is also
+    limited so that each process holds at least two elements.
+*/
+int ComputationParams::GroupSize(const Args& args)
+{
+    if (args.GroupSize())
+    {
+        return args.GroupSize();
+    }
+
+    const int pes = Backend::NPes();
+    int result = 1 << intlog2(pes);
+    if (result != pes && result > 1)
+    {
+        result /= 2;
+    }
+
+    const Index max_group_size = Index(1) << (args.QubitCount() - 1);
+    if (Index(result) > max_group_size)
+    {
+        result = max_group_size;
+    }
+    return result;
+}
+
+/*
+    PEs sorted by node, nodes are numbered in order of their first PE so
+    master stays in slot 0. Gives identity when nodes hold consecutive
+    PEs.
+*/
+vector<int> ComputationParams::SlotPes()
+{
+    vector<int> result(Backend::NPes());
+    for (Index i = 0; i < result.size(); i++)
+    {
+        result[i] = i;
+    }
+    stable_sort(result.begin(), result.end(), [](const int a, const int b)
+        {
+            return NodeShm::Node(a) < NodeShm::Node(b);
+        });
+    return result;
+}
+
 void ComputationParams::SetTargetQubit(const int target_qubit)
 {
     this->target_qubit     = target_qubit;
@@ -27,9 +100,12 @@ void ComputationParams::SetTargetQubit(const int target_qubit)
     if (target_qubit_is_global)
     {
         worker_target_qubit = 1;
-        const Index mask    = 1L << (global_qubit_count - target_qubit);
-        target_qubit_value  = (shmem_my_pe() & mask) ? 1 : 0;
-        partner_rank        = shmem_my_pe() ^ mask;
+        // global qubits are bits of rank
+        const int mask      = 1 << (global_qubit_count - target_qubit);
+        target_qubit_value  = (group_rank & mask) ? 1 : 0;
+        // idle processes have no group and exchange nothing
+        partner_rank        = idle ? -1 : slot_pe[group * group_size +
+            (group_rank ^ mask)];
     }
     else
     {
@@ -42,6 +118,31 @@ Index ComputationParams::WorkerVectorSize() const
     return worker_vector_size;
 }
 
+int ComputationParams::GroupSize() const
+{
+    return group_size;
+}
+
+int ComputationParams::GroupCount() const
+{
+    return group_count;
+}
+
+int ComputationParams::Group() const
+{
+    return group;
+}
+
+int ComputationParams::GroupRank() const
+{
+    return group_rank;
+}
+
+bool ComputationParams::Idle() const
+{
+    return idle;
+}
+
 bool ComputationParams::TargetQubitIsGlobal() const
 {
     return target_qubit_is_global;
@@ -62,6 +163,46 @@ int ComputationParams::PartnerRank() const
     return partner_rank;
 }
 
+// every half is sent to partner and back
+Index ComputationParams::ExchangeBytesPerSweep() const
+{
+    return Index(group_count) * group_size * global_qubit_count *
+        worker_vector_size * sizeof(complexd);
+}
+
+Index ComputationParams::CrossNodeBytesPerSweep() const
+{
+    return CrossNodeBytesPerSweep(slot_pe);
+}
+
+Index ComputationParams::CrossNodeBytesPerSweepRankOrder() const
+{
+    vector<int> rank_order(slot_pe.size());
+    for (Index i = 0; i < rank_order.size(); i++)
+    {
+        rank_order[i] = i;
+    }
+    return CrossNodeBytesPerSweep(rank_order);
+}
+
+Index ComputationParams::CrossNodeBytesPerSweep(const vector<int>& slot_pe)
+    const
+{
+    Index pair_count = 0;
+    for (int slot = 0; slot < group_count * group_size; slot++)
+    {
+        for (int mask = 1; mask < group_size; mask <<= 1)
+        {
+            if (NodeShm::Node(slot_pe[slot]) !=
+                NodeShm::Node(slot_pe[slot ^ mask]))
+            {
+                pair_count++;
+            }
+        }
+    }
+    return pair_count * worker_vector_size * sizeof(complexd);
+}
+
 #ifdef DEBUG
 void ComputationParams::PrintAll() const
 {
@@ -73,6 +214,12 @@ void ComputationParams::PrintAll() const
     cout << INDENT(I) << "most_significant_local_qubit = "
         << most_significant_local_qubit << endl;
     cout << INDENT(I) << "worker_vector_size = " << worker_vector_size << endl;
+    cout << INDENT(I) << "group_size = " << group_size << endl;
+    cout << INDENT(I) << "group_count = " << group_count << endl;
+    cout << INDENT(I) << "group = " << group << endl;
+    cout << INDENT(I) << "group_rank = " << group_rank << endl;
+    cout << INDENT(I) << "idle = " << idle << endl;
+    cout << INDENT(I) << "node = " << NodeShm::Node(Backend::MyPe()) << endl;
 
     // these params change every time target_qubit changes
     if (target_qubit != -1)
@@ -93,4 +240,15 @@ void ComputationParams::PrintAll() const
     }
     cout << INDENT(I - 1) << "ComputationParams::PrintAll() return" << endl;
 }
+
+void ComputationParams::RecordTarget() const
+{
+    EventLog::Record(EventLog::params_target, target_qubit,
+        worker_target_qubit, double(target_qubit_is_global));
+    if (target_qubit_is_global)
+    {
+        EventLog::Record(EventLog::params_partner, partner_rank,
+            target_qubit_value);
+    }
+}
 #endif
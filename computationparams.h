@@ -1,6 +1,7 @@
 #ifndef COMPUTATIONPARAMS_H
 #define COMPUTATIONPARAMS_H
 
+#include "args.h"
 #include "typedefs.h"
 
 class ComputationParams
@@ -12,6 +13,27 @@ class ComputationParams
 
     Index worker_vector_size;
 
+    /*
+        Processes are split into groups of group_size processes, each group
+        holds its own state vector and computes its own iteration.
+        Processes left over are idle.
+    */
+    int group_size;
+    int group_count;
+    int group;
+    int group_rank;
+    bool idle;
+
+    /*
+        PE holding each slot, slot of a PE is group * group_size +
+        group_rank. PEs of one node take consecutive slots so that low
+        bits of group rank, i. e. the last global qubits, are exchanged
+        within nodes.
+    */
+    vector<int> slot_pe;
+    static vector<int> SlotPes();
+    Index CrossNodeBytesPerSweep(const vector<int>& slot_pe) const;
+
     // these params change every time target_qubit changes
     int target_qubit;
     int worker_target_qubit;
@@ -22,11 +44,19 @@ class ComputationParams
     int partner_rank;
 
     public:
-    ComputationParams(const int qubit_count);
+    // largest qubit count whose sizes and indices fit in Index
+    static const int max_qubit_count;
+    ComputationParams(const Args& args);
     void SetTargetQubit(const int target_qubit);
+    static int GroupSize(const Args& args);
 
     // these params don't change during execution
     Index WorkerVectorSize() const;
+    int GroupSize() const;
+    int GroupCount() const;
+    int Group() const;
+    int GroupRank() const;
+    bool Idle() const;
 
     // these params change every time target_qubit changes
     int WorkerTargetQubit() const;
@@ -36,8 +66,17 @@ class ComputationParams
     int TargetQubitValue() const;
     int PartnerRank() const;
 
+    // bytes sent between nodes by all PEs in one transform of each qubit
+    Index CrossNodeBytesPerSweep() const;
+    // the same if slots were taken in order of PE numbers
+    Index CrossNodeBytesPerSweepRankOrder() const;
+    // bytes sent by all PEs in one transform of each qubit
+    Index ExchangeBytesPerSweep() const;
+
     #ifdef DEBUG
     void PrintAll() const;
+    // params of the current target qubit to EventLog, cheap for every gate
+    void RecordTarget() const;
     #endif
 };
 
@@ -0,0 +1,60 @@
+/*
+    eventlog-decode, built with the debug program. Prints event logs
+    written by EventLog as the indented text of the program, with -t
+    each event is preceded by its time in nanoseconds since the first
+    event of its file.
+*/
+
+#include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
+#include <iostream> // std::cout, std::cerr
+#include <string>
+
+#include "eventlog.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+int main(int argc, char** argv)
+{
+    bool times = false;
+    int exit_code = EXIT_SUCCESS;
+    int file_count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg(argv[i]);
+        if (arg == "-t")
+        {
+            times = true;
+            continue;
+        }
+
+        EventLog::Header header;
+        vector<EventLog::Event> events;
+        if (!EventLog::ReadFromFile(arg, header, events))
+        {
+            cerr << "Cannot read event log " << arg << endl;
+            exit_code = EXIT_FAILURE;
+            continue;
+        }
+        file_count++;
+        cout << "# pe " << header.pe << " events " << header.count
+            << " overwritten " << header.recorded - header.count << endl;
+        for (auto& e: events)
+        {
+            if (times)
+            {
+                cout << e.nanoseconds - events.front().nanoseconds << " ";
+            }
+            EventLog::Format(cout, e);
+        }
+    }
+
+    if (!file_count && exit_code == EXIT_SUCCESS)
+    {
+        cerr << "Usage: eventlog-decode [-t] event_file..." << endl;
+        exit_code = EXIT_FAILURE;
+    }
+    return exit_code;
+}
@@ -0,0 +1,332 @@
+#ifdef DEBUG
+#include <chrono> // steady_clock
+#include <cstdlib> // getenv
+#include <cstring> // memcmp, memcpy
+#include <fstream> // ifstream, ofstream
+#include <iomanip> // setw
+#include <iostream> // std::cerr
+#include <sstream> // ostringstream, istringstream
+
+#include "eventlog.h"
+#include "debug.h"
+
+using std::cerr;
+using std::ifstream;
+using std::ios;
+using std::istringstream;
+using std::ofstream;
+using std::ostringstream;
+using std::setw;
+
+namespace chrono = std::chrono;
+
+const EventLog::Level EventLog::type_level[type_count] = {
+    level_call,    // barrier
+    level_param,   // vector_begin
+    level_element, // vector_element
+    level_param,   // matrix_element
+    level_call,    // apply_operator_begin
+    level_call,    // apply_operator_end
+    level_call,    // apply_operator_blocked_begin
+    level_call,    // apply_operator_blocked_end
+    level_call,    // apply_controlled_operator_begin
+    level_call,    // apply_controlled_operator_end
+    level_call,    // apply_two_qubit_operator_begin
+    level_call,    // apply_two_qubit_operator_end
+    level_call,    // worker_random_begin
+    level_call,    // worker_random_end
+    level_call,    // worker_apply_operator_begin
+    level_call,    // worker_apply_operator_end
+    level_call,    // worker_apply_circuit_begin
+    level_call,    // worker_apply_circuit_end
+    level_call,    // worker_apply_controlled_begin
+    level_call,    // worker_apply_controlled_end
+    level_call,    // worker_apply_two_qubit_begin
+    level_call,    // worker_apply_two_qubit_end
+    level_call,    // worker_swap_begin
+    level_call,    // worker_swap_end
+    level_param,   // params_target
+    level_param,   // params_partner
+    level_call,    // shmem_set_receive_vector
+    level_call,    // shmem_send_begin
+    level_element, // shmem_send_message
+    level_call,    // shmem_send_end
+    level_element  // shmem_receive
+};
+
+thread_local vector<EventLog::Event> EventLog::ring;
+thread_local uint64_t EventLog::recorded = 0;
+thread_local int EventLog::pe = 0;
+thread_local int EventLog::max_level = level_element;
+thread_local uint64_t EventLog::sample_period = 1;
+thread_local uint64_t EventLog::sample_count = 0;
+thread_local string EventLog::prefix;
+const char EventLog::magic[4] = {'F', 'E', 'V', 'L'};
+
+namespace
+{
+    template <class Number>
+    Number EnvNumber(const char* name, const Number default_value)
+    {
+        const char* s = getenv(name);
+        Number n = default_value;
+        if (s)
+        {
+            istringstream iss(s);
+            iss >> n;
+        }
+        return n;
+    }
+
+    uint64_t Nanoseconds()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+void EventLog::Start(const int pe)
+{
+    EventLog::pe = pe;
+    const char* p = getenv("EVENTLOG");
+    prefix = p ? p : "events";
+    max_level = EnvNumber<int>("EVENTLOG_LEVEL", level_element);
+    sample_period = EnvNumber<uint64_t>("EVENTLOG_SAMPLE", 1);
+    sample_period = sample_period ? sample_period : 1;
+    const uint64_t size = EnvNumber<uint64_t>("EVENTLOG_SIZE", 1 << 16);
+    uint64_t capacity = 1;
+    while (capacity < size)
+    {
+        capacity *= 2;
+    }
+    ring.assign(capacity, Event());
+    recorded = 0;
+    sample_count = 0;
+}
+
+// single writer per buffer, no locks
+void EventLog::Record(const Type type, const int arg, const Index index,
+    const complexd value)
+{
+    const int level = type_level[type];
+    if (ring.empty() || level > max_level ||
+        (level == level_element && sample_count++ % sample_period))
+    {
+        return;
+    }
+    Event& e = ring[recorded++ & (ring.size() - 1)];
+    e.nanoseconds = Nanoseconds();
+    e.type = type;
+    e.arg = arg;
+    e.index = index;
+    e.value = value;
+}
+
+void EventLog::RecordVector(const Vector& psi)
+{
+    if (ring.empty() || max_level < level_param)
+    {
+        return;
+    }
+    Record(vector_begin, 0, psi.size());
+    for (Index i = 0; max_level >= level_element && i < psi.size(); i++)
+    {
+        Record(vector_element, 0, i, psi[i]);
+    }
+}
+
+void EventLog::RecordMatrix(const Matrix& U)
+{
+    for (Index row = 0; row < U.size(); row++)
+    {
+        for (Index col = 0; col < U[row].size(); col++)
+        {
+            Record(matrix_element, row, col, U[row][col]);
+        }
+    }
+}
+
+void EventLog::WriteToFile()
+{
+    if (ring.empty())
+    {
+        return;
+    }
+    ostringstream filename;
+    filename << prefix << "-" << pe << ".bin";
+    const uint64_t count = recorded < ring.size() ? recorded : ring.size();
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.event_size = sizeof(Event);
+    header.pe = pe;
+    header.recorded = recorded;
+    header.count = count;
+
+    ofstream fs(filename.str().c_str(), ios::binary);
+    fs.write((const char*) &header, sizeof(header));
+    for (uint64_t i = recorded - count; i < recorded; i++)
+    {
+        fs.write((const char*) &ring[i & (ring.size() - 1)], sizeof(Event));
+    }
+    if (!fs)
+    {
+        cerr << "Cannot write event log " << filename.str() << endl;
+    }
+}
+
+bool EventLog::ReadFromFile(const string& filename, Header& header,
+    vector<Event>& events)
+{
+    ifstream fs(filename.c_str(), ios::binary);
+    if (!fs.read((char*) &header, sizeof(header)) ||
+        memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+        header.version != version || header.event_size != sizeof(Event))
+    {
+        return false;
+    }
+    events.resize(header.count);
+    fs.read((char*) events.data(), header.count * sizeof(Event));
+    return bool(fs);
+}
+
+void EventLog::Format(ostream& os, const Event& e)
+{
+    // masks and counts beyond int are kept in the real part of value
+    const Index index2 = e.value.real();
+    switch (e.type)
+    {
+        case barrier:
+        {
+            const string line(2 * INDENT_WIDTH, '-');
+            os << line << "barrier " << setw(6) << e.index << line << endl;
+            break;
+        }
+        case vector_begin:
+            os << INDENT(4) << "psi:" << endl;
+            break;
+        case vector_element:
+            os << INDENT(5) << e.value << endl;
+            break;
+        case matrix_element:
+            if (e.arg == 0 && e.index == 0)
+            {
+                os << INDENT(4) << "Matrix U:" << endl;
+            }
+            os << INDENT(5) << "U[" << e.arg << "][" << e.index << "] = "
+                << e.value << endl;
+            break;
+        case apply_operator_begin:
+            os << INDENT(3) << "ApplyOperator()..." << endl;
+            os << INDENT(4) << "target_qubit = " << e.arg << endl;
+            break;
+        case apply_operator_end:
+            os << INDENT(3) << "ApplyOperator() return" << endl;
+            break;
+        case apply_operator_blocked_begin:
+            os << INDENT(3) << "ApplyOperatorBlocked()..." << endl;
+            os << INDENT(4) << "block_size = " << e.index << endl;
+            break;
+        case apply_operator_blocked_end:
+            os << INDENT(3) << "ApplyOperatorBlocked() return" << endl;
+            break;
+        case apply_controlled_operator_begin:
+            os << INDENT(3) << "ApplyControlledOperator()..." << endl;
+            os << INDENT(4) << "control_mask = " << e.index << endl;
+            os << INDENT(4) << "target_mask = " << index2 << endl;
+            break;
+        case apply_controlled_operator_end:
+            os << INDENT(3) << "ApplyControlledOperator() return" << endl;
+            break;
+        case apply_two_qubit_operator_begin:
+            os << INDENT(3) << "ApplyTwoQubitOperator()..." << endl;
+            os << INDENT(4) << "first_mask = " << e.index << endl;
+            os << INDENT(4) << "second_mask = " << index2 << endl;
+            break;
+        case apply_two_qubit_operator_end:
+            os << INDENT(3) << "ApplyTwoQubitOperator() return" << endl;
+            break;
+        case worker_random_begin:
+            os << INDENT(1) << "WorkerBase::VectorInitRandomBegin()..."
+                << endl;
+            os << INDENT(1) << "WorkerBase::VectorInitRandomBegin() return"
+                << endl;
+            break;
+        case worker_random_end:
+            os << INDENT(1) << "WorkerBase::VectorInitRandomEnd()..."
+                << endl;
+            os << INDENT(1) << "WorkerBase::VectorInitRandomEnd() return"
+                << endl;
+            break;
+        case worker_apply_operator_begin:
+            os << INDENT(2) << "WorkerBase::ApplyOperator()..." << endl;
+            break;
+        case worker_apply_operator_end:
+            os << INDENT(2) << "WorkerBase::ApplyOperator()... return"
+                << endl;
+            break;
+        case worker_apply_circuit_begin:
+            os << INDENT(1) << "WorkerBase::ApplyCircuit()..." << endl;
+            break;
+        case worker_apply_circuit_end:
+            os << INDENT(1) << "WorkerBase::ApplyCircuit() return" << endl;
+            break;
+        case worker_apply_controlled_begin:
+            os << INDENT(2) << "WorkerBase::ApplyControlled()..." << endl;
+            os << INDENT(3) << "target_qubit = " << e.arg << endl;
+            os << INDENT(3) << "control_qubit = " << e.index << endl;
+            break;
+        case worker_apply_controlled_end:
+            os << INDENT(2) << "WorkerBase::ApplyControlled() return" << endl;
+            break;
+        case worker_apply_two_qubit_begin:
+            os << INDENT(2) << "WorkerBase::ApplyTwoQubit()..." << endl;
+            os << INDENT(3) << "first_qubit = " << e.arg << endl;
+            os << INDENT(3) << "second_qubit = " << e.index << endl;
+            break;
+        case worker_apply_two_qubit_end:
+            os << INDENT(2) << "WorkerBase::ApplyTwoQubit() return" << endl;
+            break;
+        case worker_swap_begin:
+            os << INDENT(3) << "WorkerBase::SwapWithPartner()..." << endl;
+            os << INDENT(4) << "partner_rank = " << e.arg << endl;
+            os << INDENT(4) << "pivot_mask = " << e.index << endl;
+            break;
+        case worker_swap_end:
+            os << INDENT(3) << "WorkerBase::SwapWithPartner() return" << endl;
+            break;
+        case params_target:
+            os << INDENT(4) << "target_qubit = " << e.arg << endl;
+            os << INDENT(4) << "worker_target_qubit = " << e.index << endl;
+            os << INDENT(4) << "target_qubit_is_global = " << e.value.real()
+                << endl;
+            break;
+        case params_partner:
+            os << INDENT(4) << "target_qubit_value = " << e.index << endl;
+            os << INDENT(4) << "partner_rank = " << e.arg << endl;
+            break;
+        case shmem_set_receive_vector:
+            os << INDENT(4) << "Shmem::SetReceiveVector()..." << endl;
+            os << INDENT(4) << "Shmem::SetReceiveVector() return" << endl;
+            break;
+        case shmem_send_begin:
+            os << INDENT(4) << "Shmem::SendVector()..." << endl;
+            break;
+        case shmem_send_message:
+            os << INDENT(5) << "Index = " << e.index << ", Count = " << e.arg
+                << endl;
+            break;
+        case shmem_send_end:
+            os << INDENT(4) << "Shmem::SendVector() return" << endl;
+            break;
+        case shmem_receive:
+            os << "::ShmemReceiveElem()..." << endl;
+            os << INDENT(1) << "Index = " << e.index << ", Count = " << e.arg
+                << endl;
+            os << "::ShmemReceiveElem() return" << endl;
+            break;
+        default:
+            os << "# unknown event " << e.type << endl;
+    }
+}
+#endif // DEBUG
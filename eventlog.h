@@ -0,0 +1,127 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#ifdef DEBUG
+#include <cstdint> // uint32_t, uint64_t
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "typedefs.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+/*
+    Tracing of debug builds on hot paths. Instead of printing, each PE
+    stores fixed-size binary events in its own ring buffer, the oldest are
+    overwritten. Buffers are written to files at the end of a job and
+    eventlog-decode turns them into the indented text printed before.
+
+    Environment variables, read by Start:
+        EVENTLOG        file prefix, PE n writes prefix-n.bin, "events"
+                        by default
+        EVENTLOG_LEVEL  1 calls, 2 also parameters, 3 (default) also
+                        vector elements and messages
+        EVENTLOG_SAMPLE only every k-th event of level 3 is kept, 1 by
+                        default
+        EVENTLOG_SIZE   events per PE, rounded up to a power of two,
+                        65536 by default
+*/
+class EventLog
+{
+    public:
+    enum Level
+    {
+        level_call = 1,
+        level_param,
+        level_element
+    };
+    enum Type
+    {
+        barrier,
+        vector_begin,
+        vector_element,
+        matrix_element,
+        apply_operator_begin,
+        apply_operator_end,
+        apply_operator_blocked_begin,
+        apply_operator_blocked_end,
+        apply_controlled_operator_begin,
+        apply_controlled_operator_end,
+        apply_two_qubit_operator_begin,
+        apply_two_qubit_operator_end,
+        worker_random_begin,
+        worker_random_end,
+        worker_apply_operator_begin,
+        worker_apply_operator_end,
+        worker_apply_circuit_begin,
+        worker_apply_circuit_end,
+        worker_apply_controlled_begin,
+        worker_apply_controlled_end,
+        worker_apply_two_qubit_begin,
+        worker_apply_two_qubit_end,
+        worker_swap_begin,
+        worker_swap_end,
+        params_target,
+        params_partner,
+        shmem_set_receive_vector,
+        shmem_send_begin,
+        shmem_send_message,
+        shmem_send_end,
+        shmem_receive,
+        type_count
+    };
+    // 40 bytes, meaning of arg, index and value depends on type
+    struct Event
+    {
+        uint64_t nanoseconds;
+        uint32_t type;
+        int32_t arg;
+        uint64_t index;
+        complexd value;
+    };
+
+    private:
+    static const Level type_level[type_count];
+    static thread_local vector<Event> ring;
+    static thread_local uint64_t recorded;
+    static thread_local int pe;
+    static thread_local int max_level;
+    static thread_local uint64_t sample_period;
+    static thread_local uint64_t sample_count;
+    static thread_local string prefix;
+    static const char magic[4];
+    static const uint32_t version = 1;
+
+    public:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t event_size;
+        int32_t pe;
+        // events recorded, those beyond count were overwritten
+        uint64_t recorded;
+        uint64_t count;
+    };
+    // clears the buffer of the calling PE
+    static void Start(const int pe);
+    // does nothing before Start or above the level
+    static void Record(const Type type, const int arg = 0,
+        const Index index = 0, const complexd value = 0.0);
+    // header event followed by sampled elements
+    static void RecordVector(const Vector& psi);
+    static void RecordMatrix(const Matrix& U);
+    // oldest event first
+    static void WriteToFile();
+    // false if file is not an event log
+    static bool ReadFromFile(const string& filename, Header& header,
+        vector<Event>& events);
+    // text lines of one event as formerly printed by the program
+    static void Format(ostream& os, const Event& e);
+};
+
+#endif // DEBUG
+#endif // EVENTLOG_H
@@ -0,0 +1,381 @@
+#include <algorithm> // copy, min
+#include <cstring> // memcpy
+
+#include "exchangecodec.h"
+
+using std::copy;
+using std::memcpy;
+using std::min;
+using std::uint32_t;
+
+thread_local ExchangeCodec::Format ExchangeCodec::format =
+    ExchangeCodec::format_raw;
+thread_local vector<float> ExchangeCodec::narrow;
+thread_local vector<uint8_t> ExchangeCodec::grouped;
+thread_local vector<Index> ExchangeCodec::match_table;
+
+namespace
+{
+    uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // 255 for each full step, then the rest
+    uint8_t* WriteLength(uint8_t* out, Index length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *out++ = 255;
+        }
+        *out++ = length;
+        return out;
+    }
+
+    Index ReadLength(const uint8_t*& in, const uint8_t* const in_end)
+    {
+        Index length = 0;
+        uint8_t b = 255;
+        while (b == 255)
+        {
+            if (in == in_end)
+            {
+                throw ExchangeCodec::DecodeError(
+                    "Exchange encoding ends within a length");
+            }
+            b = *in++;
+            length += b;
+        }
+        return length;
+    }
+}
+
+ExchangeCodec::DecodeError::DecodeError(const string& msg):
+    runtime_error(msg)
+{
+
+}
+
+const char* ExchangeCodec::FormatName(const Format format)
+{
+    static const char* const names[format_count] = {
+        "raw",
+        "float",
+        "lz",
+        "float-lz"
+    };
+    return names[format];
+}
+
+bool ExchangeCodec::FormatFromName(const string& name, Format& format)
+{
+    for (int f = 0; f < format_count; f++)
+    {
+        if (name == FormatName(Format(f)))
+        {
+            format = Format(f);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ExchangeCodec::SetFormat(const Format format)
+{
+    ExchangeCodec::format = format;
+}
+
+ExchangeCodec::Format ExchangeCodec::CurrentFormat()
+{
+    return format;
+}
+
+bool ExchangeCodec::Narrow(const Format format)
+{
+    return format == format_float || format == format_float_lz;
+}
+
+bool ExchangeCodec::Compressed(const Format format)
+{
+    return format == format_lz || format == format_float_lz;
+}
+
+// incompressible input grows by its literal lengths
+Index ExchangeCodec::LzBound(const Index size)
+{
+    return size + size / 255 + 16;
+}
+
+Index ExchangeCodec::EncodedSizeBound(const Format format, const Index count)
+{
+    const Index width = Narrow(format) ? sizeof(float) : sizeof(double);
+    const Index size = 2 * count * width;
+    const Index bytes = Compressed(format) ? LzBound(size) : size;
+    return (bytes + sizeof(complexd) - 1) / sizeof(complexd);
+}
+
+Index ExchangeCodec::ScratchBytes(const Format format, const Index count)
+{
+    if (!Compressed(format))
+    {
+        return 0;
+    }
+    const Index width = Narrow(format) ? sizeof(float) : sizeof(double);
+    const Index narrow_bytes = Narrow(format) ? 2 * count * sizeof(float) : 0;
+    return narrow_bytes + 2 * count * width +
+        (Index(1) << match_table_bits) * sizeof(Index);
+}
+
+// byte k of each word goes to group k, groups follow each other
+void ExchangeCodec::Group(const uint8_t* in, const Index words,
+    const int width, uint8_t* out)
+{
+    for (Index j = 0; j < words; j++)
+    {
+        for (int k = 0; k < width; k++)
+        {
+            out[k * words + j] = in[j * width + k];
+        }
+    }
+}
+
+void ExchangeCodec::Ungroup(const uint8_t* in, const Index words,
+    const int width, uint8_t* out)
+{
+    for (Index j = 0; j < words; j++)
+    {
+        for (int k = 0; k < width; k++)
+        {
+            out[j * width + k] = in[k * words + j];
+        }
+    }
+}
+
+/*
+    Sequences of literals followed by a match within the last max_offset
+    bytes, as in LZ4: a token holds both lengths in 4 bits each, longer
+    ones continue in extra bytes, the offset takes 2 bytes. The last
+    sequence has literals only, decoder stops when its output is full.
+    Searching speeds up the longer no match is found.
+*/
+Index ExchangeCodec::LzCompress(const uint8_t* in, const Index size,
+    uint8_t* out)
+{
+    // small inputs clear a smaller table
+    int bits = 8;
+    while (bits < match_table_bits && (Index(1) << bits) < size)
+    {
+        bits++;
+    }
+    match_table.assign(Index(1) << bits, 0);
+    uint8_t* o = out;
+    Index anchor = 0;
+    Index i = 0;
+    while (i + min_match <= size)
+    {
+        const uint32_t v = Read32(in + i);
+        const Index h = uint32_t(v * 2654435761u) >> (32 - bits);
+        // positions are stored plus one, zero is an empty slot
+        const Index candidate = match_table[h];
+        match_table[h] = i + 1;
+        if (!candidate || i + 1 - candidate > max_offset ||
+            Read32(in + candidate - 1) != v)
+        {
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        const Index match = candidate - 1;
+        Index length = min_match;
+        while (i + length < size && in[match + length] == in[i + length])
+        {
+            length++;
+        }
+        const Index literal_count = i - anchor;
+        const Index extra = length - min_match;
+        *o++ = (min(literal_count, Index(15)) << 4) | min(extra, Index(15));
+        if (literal_count >= 15)
+        {
+            o = WriteLength(o, literal_count - 15);
+        }
+        o = copy(in + anchor, in + i, o);
+        const Index offset = i - match;
+        *o++ = offset & 0xff;
+        *o++ = offset >> 8;
+        if (extra >= 15)
+        {
+            o = WriteLength(o, extra - 15);
+        }
+        i += length;
+        anchor = i;
+    }
+
+    const Index literal_count = size - anchor;
+    if (literal_count)
+    {
+        *o++ = min(literal_count, Index(15)) << 4;
+        if (literal_count >= 15)
+        {
+            o = WriteLength(o, literal_count - 15);
+        }
+        o = copy(in + anchor, in + size, o);
+    }
+    return o - out;
+}
+
+void ExchangeCodec::LzDecompress(const uint8_t* in, const Index in_size,
+    uint8_t* out, const Index out_size)
+{
+    const uint8_t* const in_end = in + in_size;
+    uint8_t* const out_end = out + out_size;
+    uint8_t* o = out;
+    while (o < out_end)
+    {
+        if (in == in_end)
+        {
+            throw DecodeError("Exchange encoding is too short");
+        }
+        const int token = *in++;
+        Index literal_count = token >> 4;
+        if (literal_count == 15)
+        {
+            literal_count += ReadLength(in, in_end);
+        }
+        if (literal_count > Index(in_end - in) ||
+            literal_count > Index(out_end - o))
+        {
+            throw DecodeError("Exchange encoding has too many literals");
+        }
+        o = copy(in, in + literal_count, o);
+        in += literal_count;
+        if (o == out_end)
+        {
+            break;
+        }
+
+        if (in_end - in < 2)
+        {
+            throw DecodeError("Exchange encoding ends within an offset");
+        }
+        const Index offset = in[0] | (Index(in[1]) << 8);
+        in += 2;
+        Index length = (token & 15) + min_match;
+        if ((token & 15) == 15)
+        {
+            length += ReadLength(in, in_end);
+        }
+        if (!offset || offset > Index(o - out) ||
+            length > Index(out_end - o))
+        {
+            throw DecodeError("Exchange encoding has a bad match");
+        }
+        // source may overlap the bytes being written, copy forward
+        for (const uint8_t* m = o - offset; length; length--)
+        {
+            *o++ = *m++;
+        }
+    }
+}
+
+Index ExchangeCodec::Encode(const Vector::const_iterator& first,
+    const Index count, Vector& encoded)
+{
+    if (!count)
+    {
+        return 0;
+    }
+    const Index bound = EncodedSizeBound(format, count);
+    if (encoded.size() < bound)
+    {
+        encoded.resize(bound);
+    }
+    uint8_t* const out = reinterpret_cast<uint8_t*>(encoded.data());
+    const double* const parts = reinterpret_cast<const double*>(&*first);
+    const Index words = 2 * count;
+
+    if (!Compressed(format))
+    {
+        if (Narrow(format))
+        {
+            for (Index i = 0; i < words; i++)
+            {
+                const float f = parts[i];
+                memcpy(out + i * sizeof(float), &f, sizeof(float));
+            }
+        }
+        else
+        {
+            memcpy(out, parts, words * sizeof(double));
+        }
+        return bound;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(parts);
+    int width = sizeof(double);
+    if (Narrow(format))
+    {
+        narrow.resize(words);
+        copy(parts, parts + words, narrow.begin());
+        bytes = reinterpret_cast<const uint8_t*>(narrow.data());
+        width = sizeof(float);
+    }
+    grouped.resize(words * width);
+    Group(bytes, words, width, grouped.data());
+    const Index size = LzCompress(grouped.data(), grouped.size(), out);
+    return (size + sizeof(complexd) - 1) / sizeof(complexd);
+}
+
+void ExchangeCodec::Decode(const Vector::const_iterator& encoded,
+    const Index encoded_size, const Index count,
+    const Vector::iterator& first)
+{
+    if (!count)
+    {
+        return;
+    }
+    const uint8_t* const in = reinterpret_cast<const uint8_t*>(&*encoded);
+    const Index in_size = encoded_size * sizeof(complexd);
+    double* const parts = reinterpret_cast<double*>(&*first);
+    const Index words = 2 * count;
+
+    if (!Compressed(format))
+    {
+        const Index width = Narrow(format) ? sizeof(float) : sizeof(double);
+        if (in_size < words * width)
+        {
+            throw DecodeError("Exchange encoding is too short");
+        }
+        if (Narrow(format))
+        {
+            for (Index i = 0; i < words; i++)
+            {
+                float f;
+                memcpy(&f, in + i * sizeof(float), sizeof(float));
+                parts[i] = f;
+            }
+        }
+        else
+        {
+            memcpy(parts, in, words * sizeof(double));
+        }
+        return;
+    }
+
+    const int width = Narrow(format) ? sizeof(float) : sizeof(double);
+    grouped.resize(words * width);
+    LzDecompress(in, in_size, grouped.data(), grouped.size());
+    if (Narrow(format))
+    {
+        narrow.resize(words);
+        Ungroup(grouped.data(), words, width,
+            reinterpret_cast<uint8_t*>(narrow.data()));
+        copy(narrow.begin(), narrow.end(), parts);
+    }
+    else
+    {
+        Ungroup(grouped.data(), words, width,
+            reinterpret_cast<uint8_t*>(parts));
+    }
+}
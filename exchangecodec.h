@@ -0,0 +1,89 @@
+#ifndef EXCHANGECODEC_H
+#define EXCHANGECODEC_H
+
+#include <cstdint> // uint8_t
+#include <stdexcept> // runtime_error
+#include <string>
+
+#include "typedefs.h"
+
+using std::runtime_error;
+using std::string;
+using std::uint8_t;
+
+/*
+    Encodings of vector ranges sent to a partner on another node, chosen
+    per run:
+        raw      - elements as they are
+        float    - real and imaginary parts rounded to single precision,
+                   half the bytes, relative error of 2**-24 per exchange
+        lz       - lossless, bytes of the doubles are grouped by position
+                   (sign and exponent bytes of amplitudes are much alike)
+                   and compressed with an LZ77 scheme
+        float-lz - both, rounded floats are grouped and compressed
+    Encodings are stored in the bytes of a Vector so that backends send
+    them as any other range.
+*/
+class ExchangeCodec
+{
+    public:
+    enum Format
+    {
+        format_raw,
+        format_float,
+        format_lz,
+        format_float_lz,
+        format_count
+    };
+
+    private:
+    static thread_local Format format;
+    // scratch of Encode and Decode, grows to the largest range
+    static thread_local vector<float> narrow;
+    static thread_local vector<uint8_t> grouped;
+    static thread_local vector<Index> match_table;
+    static const int min_match = 4;
+    static const int match_table_bits = 16;
+    static const Index max_offset = 65535;
+    static bool Narrow(const Format format);
+    static bool Compressed(const Format format);
+    static Index LzBound(const Index size);
+    static void Group(const uint8_t* in, const Index words, const int width,
+        uint8_t* out);
+    static void Ungroup(const uint8_t* in, const Index words,
+        const int width, uint8_t* out);
+    static Index LzCompress(const uint8_t* in, const Index size,
+        uint8_t* out);
+    static void LzDecompress(const uint8_t* in, const Index in_size,
+        uint8_t* out, const Index out_size);
+
+    public:
+    // encoding received from partner does not decode to its range
+    class DecodeError: public runtime_error
+    {
+        public:
+        DecodeError(const string& msg);
+    };
+    static const char* FormatName(const Format format);
+    // false if name is none of the formats
+    static bool FormatFromName(const string& name, Format& format);
+    // format of the calling PE, raw by default
+    static void SetFormat(const Format format);
+    static Format CurrentFormat();
+    // elements of Vector holding any encoding of count elements
+    static Index EncodedSizeBound(const Format format, const Index count);
+    // bytes of scratch kept by Encode and Decode for count elements
+    static Index ScratchBytes(const Format format, const Index count);
+    /*
+        Encodes count elements at first into encoded, which grows if
+        needed, and returns the number of elements of encoded used.
+    */
+    static Index Encode(const Vector::const_iterator& first,
+        const Index count, Vector& encoded);
+    // replaces count elements at first by those of encoded_size elements
+    static void Decode(const Vector::const_iterator& encoded,
+        const Index encoded_size, const Index count,
+        const Vector::iterator& first);
+};
+
+#endif
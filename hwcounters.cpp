@@ -0,0 +1,320 @@
+#include <algorithm> // fill, max
+#include <cerrno> // errno
+#include <cstring> // strerror, memset, memcpy
+#include <fstream> // ifstream, ofstream
+#include <iostream> // std::cout
+#include <linux/perf_event.h> // perf_event_attr, PERF_*
+#include <sstream> // ostringstream
+#include <sys/syscall.h> // __NR_perf_event_open
+#include <unistd.h> // syscall, read, close, sysconf
+#include <vector>
+
+#include "hwcounters.h"
+#include "backend.h"
+#include "computationbase.h"
+#include "nodeshm.h"
+
+using std::cout;
+using std::endl;
+using std::fill;
+using std::ifstream;
+using std::max;
+using std::ofstream;
+using std::ostream;
+using std::ostringstream;
+using std::vector;
+
+thread_local HwCounters::Totals HwCounters::pe_totals[kernel_count];
+thread_local HwCounters::Totals* HwCounters::totals = NULL;
+thread_local double HwCounters::stream_bandwidth;
+const size_t HwCounters::default_cache_bytes;
+const size_t HwCounters::min_stream_elements;
+
+/*
+    Counter group of the calling thread, opened on first use and closed
+    when the thread exits
+*/
+class ThreadCounters
+{
+    int fd[HwCounters::counter_count];
+    bool opened;
+    public:
+    // errno of the failed open, 0 if counters work
+    int error;
+    ThreadCounters():
+        opened(false),
+        error(0)
+    {
+        fill(fd, fd + HwCounters::counter_count, -1);
+    }
+    ~ThreadCounters()
+    {
+        for (auto f: fd)
+        {
+            if (f != -1)
+            {
+                close(f);
+            }
+        }
+    }
+    bool Open()
+    {
+        if (opened)
+        {
+            return error == 0;
+        }
+        opened = true;
+        const uint64_t configs[HwCounters::counter_count] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES
+        };
+        for (int i = 0; i < HwCounters::counter_count; i++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // calling thread on any cpu, the first counter leads the group
+            fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1,
+                i ? fd[0] : -1, 0);
+            if (fd[i] == -1)
+            {
+                error = errno;
+                return false;
+            }
+        }
+        return true;
+    }
+    bool Read(uint64_t* values)
+    {
+        uint64_t buffer[1 + HwCounters::counter_count];
+        if (read(fd[0], buffer, sizeof(buffer)) != sizeof(buffer))
+        {
+            return false;
+        }
+        for (int i = 0; i < HwCounters::counter_count; i++)
+        {
+            values[i] = buffer[1 + i];
+        }
+        return true;
+    }
+};
+
+static thread_local ThreadCounters thread_counters;
+
+const char* HwCounters::KernelName(const Kernel kernel)
+{
+    static const char* const names[kernel_count] = {
+        "apply",
+        "scalar_product",
+        "normalize",
+        "init"
+    };
+    return names[kernel];
+}
+
+/*
+    Size of the largest cache level as reported by libc, or by sysfs when
+    libc does not know it
+*/
+size_t HwCounters::LastLevelCacheBytes()
+{
+    const long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (l3 > 0)
+    {
+        return l3;
+    }
+
+    size_t bytes = 0;
+    int top_level = 0;
+    for (int index = 0; index < 16; index++)
+    {
+        ostringstream dir;
+        dir << "/sys/devices/system/cpu/cpu0/cache/index" << index << "/";
+        ifstream level_file((dir.str() + "level").c_str());
+        ifstream size_file((dir.str() + "size").c_str());
+        int level;
+        size_t size;
+        string unit;
+        if (!(level_file >> level) || !(size_file >> size))
+        {
+            continue;
+        }
+        size_file >> unit;
+        size <<= unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : 0;
+        if (level >= top_level)
+        {
+            top_level = level;
+            bytes = max(bytes, size);
+        }
+    }
+    if (bytes)
+    {
+        return bytes;
+    }
+
+    const long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return l2 > 0 ? l2 : default_cache_bytes;
+}
+
+/*
+    Best of several runs of a[i] = b[i] + s * c[i], bytes per second
+    counted as in STREAM. PEs of a node run at once and share its last
+    level cache, so together their arrays are each 4 times its size.
+*/
+double HwCounters::StreamTriad()
+{
+    const size_t n = max(min_stream_elements,
+        4 * LastLevelCacheBytes() / NodeShm::NodePeCount() / sizeof(double));
+    vector<double> a(n, 0.0);
+    vector<double> b(n, 1.0);
+    vector<double> c(n, 2.0);
+    const double s = 3.0;
+    double best = 0.0;
+    for (int run = 0; run < 5; run++)
+    {
+        const double start = Backend::Time();
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = b[i] + s * c[i];
+        }
+        const double seconds = Backend::Time() - start;
+        if (seconds > 0.0)
+        {
+            best = max(best, 3 * n * sizeof(double) / seconds);
+        }
+    }
+    // keeps the loop from being optimized away
+    return a[n / 2] == 7.0 ? best : 0.0;
+}
+
+// all PEs measure at once so that each gets its share of node bandwidth
+void HwCounters::Start()
+{
+    for (auto& t: pe_totals)
+    {
+        memset(&t, 0, sizeof(t));
+    }
+    thread_counters.Open();
+    Backend::BarrierAll();
+    stream_bandwidth = StreamTriad();
+    totals = pe_totals;
+}
+
+HwCounters::Totals* HwCounters::PeTotals()
+{
+    return totals;
+}
+
+HwCounters::Scope::Scope(const Kernel kernel, const double bytes,
+    const double flops, Totals* const totals):
+    totals(totals),
+    kernel(kernel),
+    bytes(bytes),
+    flops(flops),
+    counted(false)
+{
+    if (totals)
+    {
+        counted = thread_counters.Open() && thread_counters.Read(begin);
+        start = Backend::Time();
+    }
+}
+
+HwCounters::Scope::~Scope()
+{
+    if (!totals)
+    {
+        return;
+    }
+    Totals& t = totals[kernel];
+    t.calls++;
+    t.seconds += Backend::Time() - start;
+    t.bytes += bytes;
+    t.flops += flops;
+    uint64_t end[counter_count];
+    if (counted && thread_counters.Read(end))
+    {
+        for (int i = 0; i < counter_count; i++)
+        {
+            t.counters[i] += end[i] - begin[i];
+        }
+    }
+}
+
+/*
+    One line per PE and kernel, slots of all PEs are gathered to master.
+    Bandwidth fraction is achieved bandwidth over STREAM triad bandwidth
+    of the PE, LLC miss bytes assume 64-byte lines.
+*/
+void HwCounters::WriteToFile(const string& filename)
+{
+    const int pes = Backend::NPes();
+    const int fields = sizeof(Totals) / sizeof(double);
+    const int slot_size = 1 + kernel_count * fields;
+    vector<double> x(slot_size);
+    x[0] = stream_bandwidth;
+    memcpy(&x[1], pe_totals, sizeof(pe_totals));
+    totals = NULL;
+    const vector<double> all = Backend::DoubleGather(x.data(), x.size(),
+        ComputationBase::master_rank);
+
+    if (Backend::MyPe() != ComputationBase::master_rank)
+    {
+        return;
+    }
+
+    ofstream fs;
+    ostream& s = (filename == "-") ? cout : (fs.open(filename.c_str()), fs);
+    if (thread_counters.error)
+    {
+        s << "# perf_event counters unavailable: "
+            << strerror(thread_counters.error) << endl;
+    }
+    s << "# pe kernel calls seconds bytes flops gb_per_second "
+        "gflop_per_second stream_gb_per_second stream_fraction cycles "
+        "instructions instructions_per_cycle llc_misses "
+        "llc_miss_gb_per_second" << endl;
+    for (int pe = 0; pe < pes; pe++)
+    {
+        const double* p = &all[pe * slot_size];
+        const double stream = p[0];
+        for (int k = 0; k < kernel_count; k++)
+        {
+            Totals t;
+            memcpy(&t, p + 1 + k * fields, sizeof(t));
+            if (!t.calls)
+            {
+                continue;
+            }
+            const double bandwidth = t.seconds > 0.0 ?
+                t.bytes / t.seconds : 0.0;
+            const double flop_rate = t.seconds > 0.0 ?
+                t.flops / t.seconds : 0.0;
+            const double cycles = t.counters[counter_cycles];
+            const double misses = t.counters[counter_llc_misses];
+            s << pe << " " << KernelName(Kernel(k))
+                << " " << t.calls
+                << " " << t.seconds
+                << " " << t.bytes
+                << " " << t.flops
+                << " " << bandwidth * 1e-9
+                << " " << flop_rate * 1e-9
+                << " " << stream * 1e-9
+                << " " << (stream > 0.0 ? bandwidth / stream : 0.0)
+                << " " << cycles
+                << " " << t.counters[counter_instructions]
+                << " " << (cycles > 0.0 ?
+                    t.counters[counter_instructions] / cycles : 0.0)
+                << " " << misses
+                << " " << (t.seconds > 0.0 ? misses * 64 / t.seconds : 0.0)
+                    * 1e-9
+                << endl;
+        }
+    }
+}
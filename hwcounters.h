@@ -0,0 +1,83 @@
+#ifndef HWCOUNTERS_H
+#define HWCOUNTERS_H
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <string>
+
+using std::size_t;
+using std::string;
+
+/*
+    Hardware counters (cycles, instructions, last level cache misses) read
+    through perf_event_open around memory-bound kernels, enabled with -H.
+    Bytes and floating point operations of each call are given by the
+    kernel, so achieved bandwidth may be compared with STREAM triad
+    bandwidth measured by every PE when counting starts. Without access
+    to perf events only times, bytes and operations are reported.
+*/
+class HwCounters
+{
+    public:
+    enum Kernel
+    {
+        kernel_apply,
+        kernel_scalar_product,
+        kernel_normalize,
+        kernel_init,
+        kernel_count
+    };
+    enum Counter
+    {
+        counter_cycles,
+        counter_instructions,
+        counter_llc_misses,
+        counter_count
+    };
+    // sums over calls of one kernel
+    struct Totals
+    {
+        double calls;
+        double seconds;
+        double bytes;
+        double flops;
+        double counters[counter_count];
+    };
+
+    private:
+    static thread_local Totals pe_totals[kernel_count];
+    // NULL when counting is off on this PE
+    static thread_local Totals* totals;
+    static thread_local double stream_bandwidth;
+    static const char* KernelName(const Kernel kernel);
+    // used when the cache size is not reported
+    static const size_t default_cache_bytes = size_t(32) << 20;
+    static const size_t min_stream_elements = size_t(1) << 21;
+    static size_t LastLevelCacheBytes();
+    static double StreamTriad();
+
+    public:
+    // collective, turns counting on and measures STREAM bandwidth
+    static void Start();
+    // totals of the calling PE, for kernels run by helper threads
+    static Totals* PeTotals();
+    // adds a kernel call from construction to destruction to totals
+    class Scope
+    {
+        Totals* const totals;
+        const Kernel kernel;
+        const double bytes;
+        const double flops;
+        double start;
+        bool counted;
+        uint64_t begin[counter_count];
+        public:
+        Scope(const Kernel kernel, const double bytes, const double flops,
+            Totals* const totals = PeTotals());
+        ~Scope();
+    };
+    // collective, master writes totals of every PE and counting stops
+    static void WriteToFile(const string& filename);
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include <algorithm> // max
+#include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
+#include <iostream> // std::cin, std::cout, std::cerr
+#include <sstream> // istringstream
+
+#ifdef DEBUG
+#include "debug.h"
+#endif
+
+#include "jobserver.h"
+#include "backend.h"
+#include "computationbase.h"
+#include "master.h"
+#include "parser.h"
+
+using std::cerr;
+using std::cin;
+using std::cout;
+using std::endl;
+using std::getline;
+using std::istringstream;
+using std::max;
+
+JobServer::JobServer(const int argc, char** const argv, const Args& args):
+    job_stream(NULL)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const string option(argv[i]);
+        if (option == "-J")
+        {
+            i++; // file name
+        }
+        else if (option.compare(0, 2, "-J") != 0)
+        {
+            default_options.push_back(option);
+        }
+    }
+
+    if (Backend::MyPe() == ComputationBase::master_rank)
+    {
+        if (args.JobFileName() == "-")
+        {
+            job_stream = &cin;
+        }
+        else
+        {
+            job_file.open(args.JobFileName().c_str());
+            if (!job_file)
+            {
+                cerr << "Cannot open job file " << args.JobFileName() << endl;
+            }
+            job_stream = job_file ? &job_file : NULL;
+        }
+    }
+}
+
+/*
+    Master reads the next job and sends it to all PEs as a string of
+    characters, one double each, preceded by its length. Negative length
+    means there are no more jobs.
+*/
+bool JobServer::ReceiveJob(vector<string>& options)
+{
+    string line;
+    if (Backend::MyPe() == ComputationBase::master_rank)
+    {
+        bool found = false;
+        while (!found && getline(*job_stream, line))
+        {
+            const auto first = line.find_first_not_of(" \t");
+            found = first != string::npos && line[first] != '#';
+        }
+        if (!found)
+        {
+            line.clear();
+        }
+        double length = found ? line.size() : -1.0;
+        Backend::DoubleToAll(&length, 1, ComputationBase::master_rank);
+        if (!found)
+        {
+            return false;
+        }
+        vector<double> chars(line.begin(), line.end());
+        Backend::DoubleToAll(chars.data(), chars.size(),
+            ComputationBase::master_rank);
+    }
+    else
+    {
+        double length;
+        Backend::DoubleToAll(&length, 1, ComputationBase::master_rank);
+        if (length < 0.0)
+        {
+            return false;
+        }
+        vector<double> chars(length);
+        Backend::DoubleToAll(chars.data(), chars.size(),
+            ComputationBase::master_rank);
+        line.assign(chars.begin(), chars.end());
+    }
+
+    #ifdef DEBUG
+    cout << "JobServer::ReceiveJob(): " << line << endl;
+    #endif
+
+    options = default_options;
+    istringstream iss(line);
+    string option;
+    while (iss >> option)
+    {
+        options.push_back(option);
+    }
+    return true;
+}
+
+/*
+    A job with invalid options is reported and skipped by all PEs alike,
+    errors of a running job are reported by run_job. All PEs fail if
+    master cannot read the job file.
+*/
+int JobServer::Run(const function<void(const Args&)>& check,
+    const function<int(const Args&, const int)>& run_job)
+{
+    const bool master = Backend::MyPe() == ComputationBase::master_rank;
+    double readable = master && job_stream;
+    Backend::DoubleToAll(&readable, 1, ComputationBase::master_rank);
+    if (readable == 0.0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int exit_code = EXIT_SUCCESS;
+    int job_count = 0;
+    const double start = Backend::Time();
+    vector<string> options;
+    while (ReceiveJob(options))
+    {
+        job_count++;
+        const double job_start = Backend::Time();
+
+        // getopt needs argv of modifiable strings which outlive Args
+        vector<char*> argv(1, (char*) "fidelity");
+        for (auto& s: options)
+        {
+            argv.push_back(&s[0]);
+        }
+        argv.push_back(NULL);
+
+        try
+        {
+            Parser parser(argv.size() - 1, argv.data());
+            Args args = parser.Parse();
+            if (args.JobServerFlag())
+            {
+                throw Parser::ParseError("Job may not start a job server");
+            }
+            check(args);
+            exit_code = max(exit_code, run_job(args, job_count));
+        }
+        catch (Parser::ParseError& e)
+        {
+            if (master)
+            {
+                cerr << "Job " << job_count << ": " << e.what() << endl;
+            }
+            exit_code = EXIT_FAILURE;
+        }
+        catch (Master::IdleWorkersError& e)
+        {
+            if (master)
+            {
+                cerr << "Job " << job_count << ": " << e.what() << endl;
+            }
+            exit_code = EXIT_FAILURE;
+        }
+
+        if (master)
+        {
+            cout << "# job " << job_count << " seconds "
+                << Backend::Time() - job_start << endl;
+        }
+    }
+
+    if (master)
+    {
+        const double seconds = Backend::Time() - start;
+        cout << "# jobs " << job_count << " seconds " << seconds
+            << " jobs_per_second " << job_count / seconds << endl;
+    }
+    return exit_code;
+}
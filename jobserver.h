@@ -0,0 +1,42 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <fstream> // ifstream
+#include <functional> // function
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "args.h"
+
+using std::function;
+using std::ifstream;
+using std::istream;
+using std::string;
+using std::vector;
+
+/*
+    Keeps PEs running between jobs. Master reads one job per line of job
+    file, a line holds options as on the command line. Options given
+    together with -J are defaults of every job. Empty lines and lines
+    starting with '#' are skipped.
+*/
+class JobServer
+{
+    // launch options without -J
+    vector<string> default_options;
+    ifstream job_file;
+    // NULL if job file cannot be opened, always NULL on other PEs
+    istream* job_stream;
+    bool ReceiveJob(vector<string>& options);
+    public:
+    JobServer(const int argc, char** const argv, const Args& args);
+    /*
+        Runs jobs until end of job file. check validates arguments on
+        every PE, run_job is called with job number starting from one.
+    */
+    int Run(const function<void(const Args&)>& check,
+        const function<int(const Args&, const int)>& run_job);
+};
+
+#endif
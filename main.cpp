@@ -19,29 +19,166 @@
         This program uses a parallel algorithm to speed up the transform and
         allow for larger vectors.
 
-        A specific shmem implementation (DISLIB) is used for communication
-        between processes.
+        Communication between processes goes through Backend: a specific
+        shmem implementation (DISLIB) or threads of a single process.
 */
 
-#include <dislib.h>
 #include <cstdlib> // EXIT_FAILURE, EXIT_SUCCESS
-#include <stdlib.h> // srand
 #include <iostream> // std::cout, std::cerr
 
 #ifdef WAITFORGDB
 #include "debug.h"
 #endif
 
+#ifdef DEBUG
+#include "eventlog.h"
+#endif
+
+#include "autotuner.h"
+#include "backend.h"
 #include "computationbase.h"
+#include "exchangecodec.h"
+#include "hwcounters.h"
+#include "jobserver.h"
 #include "parser.h"
+#include "productstateworker.h"
 #include "remoteworker.h"
 #include "master.h"
 #include "routines.h"
-#include "shmem.h"
+#include "statememory.h"
+#include "stats.h"
+#include "trace.h"
 
 using std::cerr;
 using std::endl;
 
+// throws if arguments do not fit number of processes
+static void CheckArgs(const Args& args)
+{
+    if (args.ProductStateFlag())
+    {
+        if (args.CircuitSpec().HasTwoQubitGates())
+        {
+            throw Parser::ParseError(
+                "Two-qubit gates need dense state, not product state");
+        }
+    }
+    else
+    {
+        const Index vector_size = Index(1) << args.QubitCount();
+        const int group_size = ComputationParams::GroupSize(args);
+        if (group_size > Backend::NPes())
+        {
+            throw Parser::ParseError(
+                "Group size exceeds number of processes");
+        }
+        if (Index(group_size) * 2 > vector_size)
+        {
+            throw Master::IdleWorkersError();
+        }
+        // global qubit of 4x4 gate is brought next to another local one
+        if (group_size > 1 && Index(group_size) * 4 > vector_size &&
+            args.CircuitSpec().HasFullTwoQubitGates())
+        {
+            throw Parser::ParseError(
+                "Two-qubit gates need at least two local qubits per process");
+        }
+    }
+}
+
+/*
+    Runs one job on each PE after arguments are parsed and checked. Errors
+    which may happen on some PEs only are handled here.
+*/
+static int RunPe(const Args& args, const int job)
+{
+    int exit_code = EXIT_SUCCESS;
+
+    #ifdef DEBUG
+    EventLog::Start(Backend::MyPe());
+    #endif
+
+    // jobs started within one second still get different seeds
+    ComputationBase::SetSeed(MixSeed(GetUniqueSeed(), job));
+    StateMemory::SetDirectory(args.OutOfCoreFlag() ? args.OutOfCoreDir() :
+        "");
+    // settings of a previous job do not carry over
+    Autotuner::Apply(args.AutotuneFlag() && !args.PreflightFlag() ?
+        Autotuner::Find(args) : Autotuner::Settings());
+    ExchangeCodec::SetFormat(args.ExchangeFormat());
+    // counters and phase times of every PE start from zero for each job
+    Stats::ResetCounters();
+
+    try
+    {
+        if (args.PreflightFlag())
+        {
+            if (Backend::MyPe() == ComputationBase::master_rank)
+            {
+                Master::PrintPreflight(args);
+            }
+        }
+        else
+        {
+            if (args.TraceFlag())
+            {
+                Trace::Start();
+            }
+            if (args.HwCountersFlag())
+            {
+                HwCounters::Start();
+            }
+
+            if (Backend::MyPe() == ComputationBase::master_rank)
+            {
+                Master master(args);
+                master.Run();
+            }
+            else if (args.ProductStateFlag())
+            {
+                ProductStateWorker worker(args);
+                worker.Run();
+            }
+            else
+            {
+                RemoteWorker worker(args);
+                worker.Run();
+            }
+
+            if (args.TraceFlag())
+            {
+                Trace::WriteToFile(args.TraceFileName());
+            }
+            if (args.HwCountersFlag())
+            {
+                HwCounters::WriteToFile(args.HwCountersFileName());
+            }
+        }
+    }
+    // restore fails on all PEs alike, they may return
+    catch (Checkpoint::Error& e)
+    {
+        cerr << e.what() << endl;
+        exit_code = EXIT_FAILURE;
+    }
+    // these hit single PEs, partners would wait for them
+    catch (StateMemory::MapError& e)
+    {
+        cerr << e.what() << endl;
+        Backend::Abort(EXIT_FAILURE);
+    }
+    catch (ExchangeCodec::DecodeError& e)
+    {
+        cerr << e.what() << endl;
+        Backend::Abort(EXIT_FAILURE);
+    }
+
+    #ifdef DEBUG
+    EventLog::WriteToFile();
+    #endif
+    return exit_code;
+}
+
 int main(int argc, char** argv)
 {
     #ifdef WAITFORGDB
@@ -49,16 +186,14 @@ int main(int argc, char** argv)
     #endif
     int exit_code = EXIT_SUCCESS;
 
-    shmem_init(&argc, &argv);
-    shmem_register_handler(ShmemReceiveElem, Shmem::HandlerNumber());
-
-    srand(GetUniqueSeed());
+    Backend::Init(&argc, &argv);
 
+    // arguments are parsed once per process, before PEs are started
     try
     {
         if (argc == 1)
         {
-            if (shmem_my_pe() == ComputationBase::master_rank)
+            if (Backend::MyPe() == ComputationBase::master_rank)
             {
                 Parser::PrintUsage();
             }
@@ -67,26 +202,27 @@ int main(int argc, char** argv)
         {
             Parser parser(argc, argv);
             Args args = parser.Parse();
-            const int vector_size = 1L << args.QubitCount();
-            if (shmem_n_pes() * 2 > vector_size)
+            if (args.JobServerFlag())
             {
-                throw Master::IdleWorkersError();
-            }
-            if (shmem_my_pe() == ComputationBase::master_rank)
-            {
-                Master master(args);
-                master.Run();
+                exit_code = Backend::Run([argc, argv, &args]()
+                    {
+                        JobServer server(argc, argv, args);
+                        return server.Run(CheckArgs, RunPe);
+                    });
             }
             else
             {
-                RemoteWorker worker(args);
-                worker.Run();
+                CheckArgs(args);
+                exit_code = Backend::Run([&args]()
+                    {
+                        return RunPe(args, 0);
+                    });
             }
         }
     }
     catch (Parser::ParseError& e)
     {
-        if (shmem_my_pe() == ComputationBase::master_rank)
+        if (Backend::MyPe() == ComputationBase::master_rank)
         {
             cerr << e.what() << endl;
             Parser::PrintUsage();
@@ -95,12 +231,12 @@ int main(int argc, char** argv)
     }
     catch (Master::IdleWorkersError& e)
     {
-        if (shmem_my_pe() == ComputationBase::master_rank)
+        if (Backend::MyPe() == ComputationBase::master_rank)
         {
             cerr << e.what() << endl;
         }
         exit_code = EXIT_FAILURE;
     }
-    shmem_finalize();
+    Backend::Finalize();
     return exit_code;
 }
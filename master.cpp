@@ -1,32 +1,43 @@
-#include <dislib.h>
-#include <fstream>
+#include <algorithm> // min
 #include <iostream> // std::cin, std::cout
+#include <string> // getline
 
 #include "master.h"
+#include "backend.h"
 #include "routines.h"
 #include "normaldistributiongenerator.h"
-#include "shmem.h"
+#include "nodeshm.h"
+#include "statememory.h"
 #include "stats.h"
+#include "trace.h"
 
 #ifdef DEBUG
 #include "debug.h"
 #endif
 
-using std::ofstream;
-using std::ostream;
+using std::min;
 
 using std::cin;
 using std::cout;
 using std::endl;
+using std::getline;
+using std::ifstream;
+using std::string;
 
 Master::Master(const Args& args):
     ComputationBase(args),
-    fidelity(args.IterationCount()),
-    local_worker(args)
+    local_worker(args.ProductStateFlag() ? NULL : new WorkerBase(args)),
+    product_worker(args.ProductStateFlag() ?
+        new ProductStateWorker(args) : NULL),
+    one_minus_fidelity(args.Epsilons().size()),
+    fidelity_stream(NULL)
 {
     #ifdef DEBUG
     cout << "Master::Master()..." << endl;
-    params.PrintAll();
+    if (local_worker)
+    {
+        local_worker->params.PrintAll();
+    }
     cout << "Master::Master() return" << endl;
     #endif
 }
@@ -37,64 +48,40 @@ Master::IdleWorkersError::IdleWorkersError():
 
 }
 
-void Master::AddNoiseToMatrix()
+/*
+    Sends noise samples of all groups in one broadcast, NoiseCount()
+    values per group. Workers build noisy matrices for each epsilon
+    themselves
+*/
+void Master::BroadcastNoise(const vector<double>& xi)
 {
     #ifdef DEBUG
-    cout << INDENT(1) << "Master::AddNoiseToMatrix()..." << endl;
-    #endif
-
-    NormalDistributionGenerator gen;
-    const double xi = gen();
-    const double theta = args.Epsilon() * xi;
-    const complexd c = cos(theta);
-    const complexd s = sin(theta);
-    Matrix U_theta(2, Vector(2));
-
-    U_theta [0][0] = c;
-    U_theta [0][1] = s;
-    U_theta [1][0] = -1.0 * s;
-    U_theta [1][1] = c;
-
-    U = MatrixMultiply(U, U_theta);
-
-    #ifdef DEBUG
-    cout << INDENT(2) << "xi = " << xi << endl;
-    cout << INDENT(2) << "theta = " << theta << endl;
-    #endif
-
-    #ifdef DEBUG
-    cout << INDENT(1) << "Master::AddNoiseToMatrix() return" << endl;
+    cout << INDENT(1) << "Master::BroadcastNoise()..." << endl;
     #endif
-}
 
-void Master::BroadcastMatrix()
-{
     #ifdef DEBUG
-    cout << INDENT(1) << "Master::BroadcastMatrix()..." << endl;
+    for (auto x: xi)
+    {
+        cout << INDENT(2) << "xi = " << x << endl;
+    }
     #endif
 
-    local_worker.U = U;
-
-    for (auto row: U)
+    vector<double> x(xi);
     {
-        for (auto elem: row)
-        {
-            vector<double> complex_array(2);
-            complex_array[0] = elem.real();
-            complex_array[1] = elem.imag();
-            for (auto x: complex_array)
-            {
-                shmem_double_toall(&x, master_rank);
-            }
-        }
+        PhaseTimer timer(Stats::phase_broadcast);
+        Backend::DoubleToAll(x.data(), x.size(), master_rank);
     }
 
     #ifdef DEBUG
-    cout << INDENT(1) << "Master::BroadcastMatrix() return" << endl;
+    cout << INDENT(1) << "Master::BroadcastNoise() return" << endl;
     #endif
 }
 
-void Master::ComputationTimeWriteToFile()
+/*
+    Totals are those of master. They are followed by minimum, mean and
+    maximum over PEs of each phase, see Stats::PhaseTimeSummary.
+*/
+void Master::ComputationTimeWriteToFile(const vector<double>& phases)
 {
     ofstream fs;
     ostream& s = (args.ComputationTimeFileName() == "-") ? cout :
@@ -102,6 +89,13 @@ void Master::ComputationTimeWriteToFile()
     s << timer_total.Total() << endl;
     s << timer_init.Total() << endl;
     s << timer_transform.Total() << endl;
+    for (int phase = 0; phase < Stats::phase_count; phase++)
+    {
+        s << Stats::PhaseName(Stats::Phase(phase)) << " "
+            << phases[3 * phase] << " "
+            << phases[3 * phase + 1] << " "
+            << phases[3 * phase + 2] << endl;
+    }
 }
 
 void Master::StatsWriteToFile()
@@ -109,77 +103,372 @@ void Master::StatsWriteToFile()
     ofstream fs;
     ostream& s = (args.StatsFileName() == "-") ? cout :
         (fs.open(args.StatsFileName().c_str()), fs);
-    s << Stats::SendOpCounter() * shmem_n_pes() << endl;
-    s << Stats::SendDataCounter() * shmem_n_pes() << endl;
+    s << Stats::SendOpCounter() << endl;
+    s << Stats::SendDataCounter() << endl;
+    s << Stats::IntraNodeDataCounter() << endl;
+    s << Stats::InterNodeDataCounter() << endl;
+    if (StateMemory::OutOfCore())
+    {
+        // average effective bandwidth of one process, bytes per second
+        const double seconds = Stats::IoTime();
+        s << (seconds > 0.0 ? Stats::IoDataCounter() / seconds : 0.0)
+            << endl;
+    }
+    if (args.ExchangeFormat() != ExchangeCodec::format_raw)
+    {
+        // raw to encoded bytes, encode and decode seconds of all PEs
+        s << Stats::CodecRatio() << endl;
+        s << Stats::CodecEncodeTime() << endl;
+        s << Stats::CodecDecodeTime() << endl;
+    }
 }
 
-void Master::OneMinusFidelityWriteToFile()
+/*
+    Restarted run continues output of the interrupted one: rows written
+    after the restored checkpoint are dropped, they are computed again.
+*/
+void Master::OneMinusFidelityOpen()
 {
-    ofstream fs;
-    ostream& s = (args.FidelityFileName() == "-") ? cout :
-        (fs.open(args.FidelityFileName().c_str()), fs);
-    for (auto x: fidelity)
+    if (args.FidelityFileName() == "-")
+    {
+        fidelity_stream = &cout;
+    }
+    else
+    {
+        // leading comment lines and one row per restored iteration
+        vector<string> kept;
+        if (args.RestartFlag())
+        {
+            ifstream old_file(args.FidelityFileName().c_str());
+            const long long row_count = one_minus_fidelity[0].Count();
+            long long rows = 0;
+            string line;
+            while (getline(old_file, line))
+            {
+                const bool comment = !line.empty() && line[0] == '#';
+                if (comment ? rows > 0 : rows == row_count)
+                {
+                    break;
+                }
+                rows += !comment;
+                kept.push_back(line);
+            }
+        }
+        fidelity_file.open(args.FidelityFileName().c_str());
+        for (auto& line: kept)
+        {
+            fidelity_file << line << "\n";
+        }
+        fidelity_stream = &fidelity_file;
+    }
+
+    const vector<double>& epsilons = args.Epsilons();
+    if (epsilons.size() > 1 && !args.RestartFlag())
     {
-        s << 1.0 - x << endl;
+        *fidelity_stream << "# epsilon";
+        for (auto e: epsilons)
+        {
+            *fidelity_stream << " " << e;
+        }
+        *fidelity_stream << endl;
     }
 }
 
-void Master::Run()
+// updates statistics and writes the row as soon as iteration completes
+void Master::OneMinusFidelityAdd(const vector<double>& fidelity)
 {
-    #ifdef DEBUG
-    cout << "Master::Run()..." << endl;
-    #endif
+    for (Index k = 0; k < fidelity.size(); k++)
+    {
+        one_minus_fidelity[k].Add(1.0 - fidelity[k]);
+    }
 
-    Stats::ResetCounters();
+    if (fidelity_stream)
+    {
+        ostream& s = *fidelity_stream;
+        for (Index k = 0; k < fidelity.size(); k++)
+        {
+            s << (k ? " " : "") << 1.0 - fidelity[k];
+        }
+        s << endl; // flushes
+    }
+}
 
-    timer_total.Start();
+void Master::OneMinusFidelitySummaryWrite()
+{
+    ostream& s = *fidelity_stream;
+    s << "# iterations " << one_minus_fidelity[0].Count() << endl;
+    s << "# mean";
+    for (auto& x: one_minus_fidelity)
+    {
+        s << " " << x.Mean();
+    }
+    s << endl;
+    s << "# standard_error";
+    for (auto& x: one_minus_fidelity)
+    {
+        s << " " << x.StandardError();
+    }
+    s << endl;
+}
 
-    for (auto& f: fidelity)
+/*
+    Columns with zero epsilon hold rounding error only and are not
+    checked.
+*/
+bool Master::TargetRelativeErrorReached() const
+{
+    if (one_minus_fidelity[0].Count() < min_iteration_count)
     {
-        timer_init.Start();
-        local_worker.VectorInitRandom();
-        timer_init.Stop();
+        return false;
+    }
+
+    const vector<double>& epsilons = args.Epsilons();
+    for (Index k = 0; k < epsilons.size(); k++)
+    {
+        if (epsilons[k] != 0.0 && one_minus_fidelity[k].RelativeStandardError()
+            > args.TargetRelativeError())
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-        U = HadamardMatrix();
-        local_worker.U = U;
+void Master::BroadcastStopFlag(const bool stop)
+{
+    PhaseTimer timer(Stats::phase_broadcast);
+    double x = stop ? 1.0 : 0.0;
+    Backend::DoubleToAll(&x, 1, master_rank);
+}
+
+/*
+    Every group of workers computes its own iteration so one round of the
+    loop produces as many iterations as there are groups.
+*/
+void Master::RunDense(const int first_round)
+{
+    WorkerBase& worker = *local_worker;
+    const int group_count = worker.params.GroupCount();
+    const int rounds = (args.IterationCount() + group_count - 1) /
+        group_count;
+    const vector<double>& epsilons = args.Epsilons();
+    const Index m = epsilons.size();
+
+    // state of the first round is prepared up front, states of the
+    // following rounds are generated during the previous round
+    Trace::SetRound(first_round);
+    timer_init.Start();
+    worker.VectorInitRandomBegin(RoundSeed(first_round, state_stream));
+    vector<double> sums(1, worker.VectorInitRandomEnd());
+    sums = worker.GroupAllSum(sums);
+    worker.VectorNormalize(sums[worker.GroupOffset(1)]);
+    timer_init.Stop();
+
+    for (int i = first_round; i < rounds; i++)
+    {
+        Trace::SetRound(i);
+        const bool prefetch = i + 1 < rounds;
+        if (prefetch)
+        {
+            worker.VectorInitRandomBegin(RoundSeed(i + 1, state_stream));
+        }
+
+        worker.steps = args.CircuitSpec().Fuse(NoiseMatrix(0.0));
 
         timer_transform.Start();
-        local_worker.ApplyOperatorToEachQubit();
+        worker.ApplyCircuit();
         timer_transform.Stop();
 
-        local_worker.SwapVectors();
+        worker.SwapVectors();
+
+        // the same noise sample is scaled by every epsilon so that initial
+        // state and noiseless result are shared by the whole sweep
+        NormalDistributionGenerator gen(RoundSeed(i, noise_stream));
+        vector<double> xi(group_count * NoiseCount());
+        for (auto& x: xi)
+        {
+            x = gen();
+        }
+        BroadcastNoise(xi);
+        // master belongs to the first group
+        xi.resize(NoiseCount());
+
+        sums.clear();
+        for (Index k = 0; k < m; k++)
+        {
+            if (k)
+            {
+                worker.RestoreInitialState();
+            }
+
+            worker.steps = args.CircuitSpec().Fuse(
+                NoiseMatrices(epsilons[k], xi));
+
+            timer_transform.Start();
+            worker.ApplyCircuit();
+            timer_transform.Stop();
+
+            const complexd sp = worker.ScalarProduct();
+            sums.push_back(sp.real());
+            sums.push_back(sp.imag());
+        }
+
+        if (prefetch)
+        {
+            timer_init.Start();
+            sums.push_back(worker.VectorInitRandomEnd());
+            timer_init.Stop();
+        }
+
+        // scalar products of this round and norm of the next state are
+        // reduced together
+        const Index n = sums.size();
+        sums = worker.GroupAllSum(sums);
+
+        // results of the last round beyond iteration count are dropped
+        const int count = min(group_count, args.IterationCount() -
+            i * group_count);
+        for (int g = 0; g < count; g++)
+        {
+            vector<double> fidelity(m);
+            for (Index k = 0; k < m; k++)
+            {
+                fidelity[k] = norm(complexd(sums[g * n + 2 * k],
+                    sums[g * n + 2 * k + 1]));
+            }
+            OneMinusFidelityAdd(fidelity);
+        }
 
-        AddNoiseToMatrix();
-        BroadcastMatrix();
+        if (prefetch)
+        {
+            worker.VectorNormalize(sums[worker.GroupOffset(n) + n - 1]);
+        }
+
+        CheckpointSave(i + 1, one_minus_fidelity);
+
+        if (args.TargetRelativeErrorFlag())
+        {
+            const bool stop = TargetRelativeErrorReached();
+            BroadcastStopFlag(stop);
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+}
 
+void Master::RunProductState(const int first_round)
+{
+    const int pes = Backend::NPes();
+    const int rounds = (args.IterationCount() + pes - 1) / pes;
+    const Index m = args.Epsilons().size();
+    for (int i = first_round; i < rounds; i++)
+    {
+        Trace::SetRound(i);
         timer_transform.Start();
-        local_worker.ApplyOperatorToEachQubit();
+        const vector<double> fidelity = product_worker->RunRound(i);
         timer_transform.Stop();
 
-        const complexd sp = local_worker.ScalarProduct();
-        double real = sp.real();
-        double imag = sp.imag();
-        shmem_double_allsum(&real);
-        shmem_double_allsum(&imag);
-        const complexd sp_sum = complexd(real, imag);
+        // results of the last round beyond iteration count are dropped
+        const int count = min(pes, args.IterationCount() - i * pes);
+        for (int p = 0; p < count; p++)
+        {
+            OneMinusFidelityAdd(vector<double>(fidelity.begin() + p * m,
+                fidelity.begin() + (p + 1) * m));
+        }
 
-        f = norm(sp_sum);
+        CheckpointSave(i + 1, one_minus_fidelity);
+
+        if (args.TargetRelativeErrorFlag())
+        {
+            const bool stop = TargetRelativeErrorReached();
+            BroadcastStopFlag(stop);
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+}
+
+void Master::PrintPreflight(const Args& args)
+{
+    cout << "qubit_count = " << args.QubitCount() << endl;
+    cout << "pe_count = " << Backend::NPes() << endl;
+    cout << "max_qubit_count = " << ComputationParams::max_qubit_count
+        << endl;
+    if (args.ProductStateFlag())
+    {
+        cout << "bytes_per_rank = "
+            << Index(args.QubitCount()) * 2 * sizeof(complexd) << endl;
+    }
+    else
+    {
+        const ComputationParams params(args);
+        cout << "group_size = " << params.GroupSize() << endl;
+        cout << "group_count = " << params.GroupCount() << endl;
+        cout << "idle_pe_count = "
+            << Backend::NPes() - params.GroupSize() * params.GroupCount() << endl;
+        cout << "node_count = " << NodeShm::NodeCount() << endl;
+        cout << "exchange_bytes_per_sweep = "
+            << params.ExchangeBytesPerSweep() << endl;
+        cout << "cross_node_bytes_per_sweep = "
+            << params.CrossNodeBytesPerSweep() << endl;
+        cout << "cross_node_bytes_per_sweep_rank_order = "
+            << params.CrossNodeBytesPerSweepRankOrder() << endl;
+        cout << "worker_vector_size = " << params.WorkerVectorSize() << endl;
+        cout << "bytes_per_rank = " << WorkerBase::MemoryPerRank(args,
+            params.WorkerVectorSize()) << endl;
+    }
+}
+
+void Master::Run()
+{
+    #ifdef DEBUG
+    cout << "Master::Run()..." << endl;
+    #endif
+
+    // restored before the first barrier so that a missing checkpoint
+    // stops all processes alike
+    const int first_round = CheckpointRestore(one_minus_fidelity);
+
+    if (args.FidelityWriteToFileFlag())
+    {
+        OneMinusFidelityOpen();
+    }
+
+    timer_total.Start();
+
+    if (args.ProductStateFlag())
+    {
+        RunProductState(first_round);
+    }
+    else
+    {
+        RunDense(first_round);
     }
 
     timer_total.Stop();
 
     if (args.ComputationTimeWriteToFileFlag())
     {
-        ComputationTimeWriteToFile();
+        ComputationTimeWriteToFile(Stats::PhaseTimeSummary());
     }
 
-    if (args.FidelityWriteToFileFlag())
+    if (args.FidelityWriteToFileFlag() && args.TargetRelativeErrorFlag())
+    {
+        OneMinusFidelitySummaryWrite();
+    }
+
+    if (args.StatsJsonWriteToFileFlag())
     {
-        OneMinusFidelityWriteToFile();
+        Stats::JsonWriteToFile(args.StatsJsonFileName());
     }
 
     if (args.StatsWriteToFileFlag())
     {
+        Stats::SumOverPes();
         StatsWriteToFile();
     }
 
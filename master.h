@@ -1,24 +1,46 @@
 #ifndef MASTER_H
 #define MASTER_H
 
+#include <fstream> // ofstream
+#include <memory> // unique_ptr
+#include <ostream>
 #include <stdexcept> // runtime_error
 
 #include "workerbase.h"
+#include "productstateworker.h"
+#include "runningstats.h"
 #include "timer.h"
 
+using std::ofstream;
+using std::ostream;
+using std::unique_ptr;
+
 class Master: ComputationBase
 {
-    WorkerBase local_worker;
+    // only one of the workers is created depending on initial state kind
+    unique_ptr<WorkerBase> local_worker;
+    unique_ptr<ProductStateWorker> product_worker;
     Timer timer_init;
     Timer timer_transform;
     Timer timer_total;
-    vector<double> fidelity;
+    // statistics of 1 - fidelity for each epsilon
+    vector<RunningStats> one_minus_fidelity;
+    ofstream fidelity_file;
+    ostream* fidelity_stream;
+
+    // target error is not checked before this number of iterations
+    static const int min_iteration_count = 10;
 
-    void OneMinusFidelityWriteToFile();
-    void AddNoiseToMatrix();
-    void BroadcastMatrix();
-    void ComputationTimeWriteToFile();
+    void OneMinusFidelityOpen();
+    void OneMinusFidelityAdd(const vector<double>& fidelity);
+    void OneMinusFidelitySummaryWrite();
+    bool TargetRelativeErrorReached() const;
+    void BroadcastStopFlag(const bool stop);
+    void BroadcastNoise(const vector<double>& xi);
+    void ComputationTimeWriteToFile(const vector<double>& phases);
     void StatsWriteToFile();
+    void RunDense(const int first_round);
+    void RunProductState(const int first_round);
     public:
     Master(const Args& args);
     class IdleWorkersError: public runtime_error
@@ -27,6 +49,7 @@ class Master: ComputationBase
         IdleWorkersError();
     };
     void Run();
+    static void PrintPreflight(const Args& args);
 };
 
 #endif
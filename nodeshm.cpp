@@ -0,0 +1,388 @@
+#include <algorithm> // copy, count, find, max, min
+#include <cstring> // memcpy
+#include <fcntl.h> // O_CREAT, O_RDWR, posix_fallocate, fallocate
+#include <sstream> // ostringstream
+#include <sys/mman.h> // shm_open, shm_unlink, mmap, munmap
+#include <unistd.h> // close, getpid, sysconf
+
+#include "nodeshm.h"
+#include "backend.h"
+#include "statememory.h"
+#include "stats.h"
+
+using std::copy;
+using std::count;
+using std::find;
+using std::max;
+using std::memcpy;
+using std::min;
+using std::ostringstream;
+
+vector<int> NodeShm::pe_node;
+int NodeShm::node_count;
+unsigned NodeShm::job_id;
+int NodeShm::arena_fd = -1;
+size_t NodeShm::arena_end;
+NodeShm::Published* NodeShm::published;
+map<char*, NodeShm::Block> NodeShm::arena_blocks;
+complexd* NodeShm::window;
+size_t NodeShm::window_size;
+map<int, NodeShm::Mapping> NodeShm::peer_arenas;
+
+namespace
+{
+    size_t PageSize()
+    {
+        return sysconf(_SC_PAGESIZE);
+    }
+
+    // through a buffer in cache, memcpy is fast in any build
+    void SwapRanges(complexd* a, complexd* b, const Index count)
+    {
+        const Index chunk = 2048;
+        complexd buffer[chunk];
+        for (Index i = 0; i < count; i += chunk)
+        {
+            const size_t bytes = min(chunk, count - i) * sizeof(complexd);
+            memcpy(buffer, a + i, bytes);
+            memcpy(a + i, b + i, bytes);
+            memcpy(b + i, buffer, bytes);
+        }
+    }
+}
+
+/*
+    Master numbers nodes by their keys. Then each PE creates its arena,
+    node peers open it and it is unlinked so that it vanishes even if the
+    job is killed. Sharing is off for all PEs if any PE failed, partners
+    then always take the same path.
+*/
+void NodeShm::Init(const vector<double>& node_key)
+{
+    const int pes = Backend::NPes();
+    const int me = Backend::MyPe();
+
+    // keys of all PEs, each one preceded by its length
+    vector<double> key(1, node_key.size());
+    key.insert(key.end(), node_key.begin(), node_key.end());
+    const vector<double> keys = Backend::DoubleGather(key.data(), key.size(),
+        0);
+    vector<double> nodes(pes, 0.0);
+    vector<vector<double> > node_keys;
+    for (Index i = 0, pe = 0; i < keys.size(); pe++)
+    {
+        const vector<double> k(keys.begin() + i + 1,
+            keys.begin() + i + 1 + Index(keys[i]));
+        const auto it = find(node_keys.begin(), node_keys.end(), k);
+        nodes[pe] = it - node_keys.begin();
+        if (it == node_keys.end())
+        {
+            node_keys.push_back(k);
+        }
+        i += 1 + k.size();
+    }
+    Backend::DoubleToAll(nodes.data(), pes, 0);
+    pe_node.assign(nodes.begin(), nodes.end());
+    node_count = 0;
+    for (auto n: pe_node)
+    {
+        node_count = max(node_count, n + 1);
+    }
+
+    double id = getpid();
+    Backend::DoubleToAll(&id, 1, 0);
+    job_id = id;
+
+    const bool peers = NodePeCount() > 1;
+    bool ok = true;
+    void* p = MAP_FAILED;
+    if (peers)
+    {
+        arena_fd = shm_open(SegmentName(me).c_str(), O_CREAT | O_RDWR,
+            0600);
+        ok = arena_fd != -1 && posix_fallocate(arena_fd, 0, PageSize()) == 0;
+        p = ok ? mmap(NULL, PageSize(), PROT_READ | PROT_WRITE, MAP_SHARED,
+            arena_fd, 0) : MAP_FAILED;
+        ok = ok && p != MAP_FAILED;
+    }
+    Backend::BarrierAll();
+    for (int pe = 0; peers && pe < pes; pe++)
+    {
+        if (pe != me && SameNode(pe))
+        {
+            const int fd = shm_open(SegmentName(pe).c_str(), O_RDWR, 0);
+            ok = ok && fd != -1;
+            const Mapping m = {NULL, 0, fd};
+            peer_arenas[pe] = m;
+        }
+    }
+    Backend::BarrierAll();
+    if (arena_fd != -1)
+    {
+        shm_unlink(SegmentName(me).c_str());
+    }
+
+    double failed = !ok;
+    Backend::DoubleAllSum(&failed, 1);
+    if (failed != 0.0)
+    {
+        if (p != MAP_FAILED)
+        {
+            munmap(p, PageSize());
+        }
+        Finalize();
+        return;
+    }
+    if (peers)
+    {
+        published = (Published*) p;
+        arena_end = PageSize();
+    }
+}
+
+void NodeShm::Finalize()
+{
+    for (auto& b: arena_blocks)
+    {
+        munmap(b.first, b.second.size);
+    }
+    arena_blocks.clear();
+    window = NULL;
+    window_size = 0;
+    for (auto& m: peer_arenas)
+    {
+        if (m.second.data)
+        {
+            munmap(m.second.data, m.second.size);
+        }
+        if (m.second.fd != -1)
+        {
+            close(m.second.fd);
+        }
+    }
+    peer_arenas.clear();
+    if (published)
+    {
+        munmap(published, PageSize());
+        published = NULL;
+    }
+    if (arena_fd != -1)
+    {
+        close(arena_fd);
+        arena_fd = -1;
+    }
+}
+
+// without Init all PEs are on a single node, as with threads backend
+int NodeShm::NodeCount()
+{
+    return pe_node.empty() ? 1 : node_count;
+}
+
+int NodeShm::Node(const int pe)
+{
+    return pe_node.empty() ? 0 : pe_node[pe];
+}
+
+int NodeShm::NodePeCount()
+{
+    if (pe_node.empty())
+    {
+        return Backend::NPes();
+    }
+    const int node = pe_node[Backend::MyPe()];
+    return count(pe_node.begin(), pe_node.end(), node);
+}
+
+bool NodeShm::SameNode(const int pe)
+{
+    if (pe_node.empty())
+    {
+        return pe >= 0 && pe < Backend::NPes();
+    }
+    return pe >= 0 && pe < (int) pe_node.size() &&
+        pe_node[pe] == pe_node[Backend::MyPe()];
+}
+
+string NodeShm::SegmentName(const int pe)
+{
+    ostringstream oss;
+    oss << "/fidelity-" << job_id << "-" << pe;
+    return oss.str();
+}
+
+bool NodeShm::Sharing()
+{
+    return published;
+}
+
+// pages are reserved so that a full node fails here, not on first write
+void* NodeShm::ArenaAllocate(const size_t size)
+{
+    if (!Sharing())
+    {
+        return NULL;
+    }
+    const size_t bytes = (size + PageSize() - 1) / PageSize() * PageSize();
+    if (posix_fallocate(arena_fd, arena_end, bytes) != 0)
+    {
+        return NULL;
+    }
+    void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+        arena_fd, arena_end);
+    if (p == MAP_FAILED)
+    {
+        fallocate(arena_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            arena_end, bytes);
+        return NULL;
+    }
+    const Block block = {arena_end, bytes};
+    arena_blocks[(char*) p] = block;
+    arena_end += bytes;
+    return p;
+}
+
+bool NodeShm::ArenaContains(const void* p)
+{
+    return arena_blocks.count((char*) p);
+}
+
+// offsets are not reused, pages of the block are given back
+void NodeShm::ArenaFree(void* p)
+{
+    const auto it = arena_blocks.find((char*) p);
+    if (it == arena_blocks.end())
+    {
+        return;
+    }
+    munmap(p, it->second.size);
+    fallocate(arena_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+        it->second.offset, it->second.size);
+    arena_blocks.erase(it);
+}
+
+bool NodeShm::ArenaOffset(const void* p, const size_t size,
+    long long& offset)
+{
+    auto it = arena_blocks.upper_bound((char*) p);
+    if (it == arena_blocks.begin())
+    {
+        return false;
+    }
+    it--;
+    const char* first = (const char*) p;
+    if (first + size > it->first + it->second.size)
+    {
+        return false;
+    }
+    offset = it->second.offset + (first - it->first);
+    return true;
+}
+
+bool NodeShm::WindowReserve(const size_t size)
+{
+    if (window_size >= size)
+    {
+        return true;
+    }
+    if (window)
+    {
+        ArenaFree(window);
+    }
+    window = (complexd*) ArenaAllocate(size);
+    window_size = window ? size : 0;
+    return window;
+}
+
+// peer arena grows, it is mapped again when more of it is needed
+char* NodeShm::PeerArena(const int pe, const size_t size)
+{
+    Mapping& m = peer_arenas.at(pe);
+    if (m.size >= size)
+    {
+        return m.data;
+    }
+    if (m.data)
+    {
+        munmap(m.data, m.size);
+    }
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+    if (p == MAP_FAILED)
+    {
+        m.data = NULL;
+        m.size = 0;
+        ostringstream oss;
+        oss << "Cannot map shared memory of PE " << pe;
+        throw StateMemory::MapError(oss.str());
+    }
+    m.data = (char*) p;
+    m.size = size;
+    return m.data;
+}
+
+/*
+    Vectors in the arena are swapped in place, each partner swaps half of
+    the elements. A range copied into the window is restored by its owner
+    from the partner, which then has nothing to do.
+*/
+bool NodeShm::Exchange(
+    const Vector::iterator& first,
+    const Vector::iterator& last,
+    const int partner_pe,
+    const function<void()>& sync)
+{
+    const Index count = last - first;
+    const size_t size = count * sizeof(complexd);
+    if (!Sharing())
+    {
+        sync();
+        return false;
+    }
+
+    Published mine = {-1, 0};
+    if (!ArenaOffset(&*first, size, mine.offset) && WindowReserve(size))
+    {
+        copy(first, last, window);
+        ArenaOffset(window, size, mine.offset);
+        mine.window = 1;
+    }
+    *published = mine;
+
+    // partner has published its range
+    sync();
+
+    const Published theirs =
+        *(const Published*) PeerArena(partner_pe, sizeof(Published));
+    if (mine.offset < 0 || theirs.offset < 0)
+    {
+        return false;
+    }
+    complexd* other = (complexd*) (PeerArena(partner_pe,
+        theirs.offset + size) + theirs.offset);
+    const Index middle = count / 2;
+    if (!mine.window && !theirs.window)
+    {
+        if (Backend::MyPe() < partner_pe)
+        {
+            SwapRanges(&*first, other, middle);
+        }
+        else
+        {
+            SwapRanges(&*first + middle, other + middle, count - middle);
+        }
+    }
+    else if (mine.window)
+    {
+        copy(other, other + count, first);
+        if (!theirs.window)
+        {
+            copy(window, window + count, other);
+        }
+    }
+    Stats::SendAdd(size);
+    Stats::IntraNodeDataCounterAdd(size);
+
+    // partner is done with both ranges
+    sync();
+    return true;
+}
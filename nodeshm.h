@@ -0,0 +1,99 @@
+#ifndef NODESHM_H
+#define NODESHM_H
+
+#include <cstddef> // size_t
+#include <functional> // function
+#include <map>
+#include <string>
+
+#include "typedefs.h"
+
+using std::function;
+using std::map;
+using std::size_t;
+using std::string;
+
+/*
+    Partner exchange through POSIX shared memory for PEs running on the
+    same node. Each PE owns an arena segment which its node peers map as
+    well. Large vectors are allocated in the arena by StateMemory, so
+    partners swap ranges in place, each one half of the elements. Ranges
+    outside the arena are first copied into a window in the arena, from
+    which the partner copies them. Used by backends with one process per
+    PE.
+*/
+class NodeShm
+{
+    // what a PE publishes in the first page of its arena for its partner
+    struct Published
+    {
+        // of the range in the arena, -1 if it could not be shared
+        long long offset;
+        // range is a copy in the window, not the vector itself
+        int window;
+    };
+    struct Block
+    {
+        size_t offset;
+        size_t size;
+    };
+    struct Mapping
+    {
+        char* data;
+        size_t size;
+        int fd;
+    };
+    // node index of each PE, nodes are numbered in order of first PE
+    static vector<int> pe_node;
+    static int node_count;
+    // distinguishes segments of concurrent jobs
+    static unsigned job_id;
+    // segments are unlinked once opened, descriptors stay open to remap
+    static int arena_fd;
+    // bytes of arena in use, freed blocks are holes
+    static size_t arena_end;
+    static Published* published;
+    // blocks allocated in the arena by their address
+    static map<char*, Block> arena_blocks;
+    static complexd* window;
+    static size_t window_size;
+    // whole arena of each node peer
+    static map<int, Mapping> peer_arenas;
+    static string SegmentName(const int pe);
+    static bool ArenaOffset(const void* p, const size_t size,
+        long long& offset);
+    static bool WindowReserve(const size_t size);
+    static char* PeerArena(const int pe, const size_t size);
+    public:
+    /*
+        Collective, called by backend once communication is up. PEs share
+        a node if their keys are equal.
+    */
+    static void Init(const vector<double>& node_key);
+    static void Finalize();
+    static int NodeCount();
+    static int Node(const int pe);
+    // PEs sharing the node of the calling PE
+    static int NodePeCount();
+    static bool SameNode(const int pe);
+    // true if large vectors are allocated in the arena
+    static bool Sharing();
+    // NULL if the node is out of shared memory
+    static void* ArenaAllocate(const size_t size);
+    // p must be the start of a block allocated in the arena
+    static bool ArenaContains(const void* p);
+    static void ArenaFree(void* p);
+    /*
+        Replaces [first, last) by the range of partner_pe on the same
+        node. sync must return only after partner has called it the same
+        number of times. Returns false after the first sync if partners
+        cannot share their ranges, the caller then sends them.
+    */
+    static bool Exchange(
+        const Vector::iterator& first,
+        const Vector::iterator& last,
+        const int partner_pe,
+        const function<void()>& sync);
+};
+
+#endif
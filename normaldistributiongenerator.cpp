@@ -1,14 +1,20 @@
-#include <stdlib.h> // rand
+#include <stdlib.h> // rand_r
 
 #include "normaldistributiongenerator.h"
 
-double NormalDistributionGenerator::operator()() const
+NormalDistributionGenerator::NormalDistributionGenerator(const unsigned seed):
+    state(seed)
+{
+
+}
+
+double NormalDistributionGenerator::operator()()
 {
     const int n = 12;
     double s = -0.5 * n;
     for (int i = 0; i < n; i++)
     {
-        const double uniform01 = ((double) rand()) / RAND_MAX;
+        const double uniform01 = ((double) rand_r(&state)) / RAND_MAX;
         s += uniform01;
     }
     return s;
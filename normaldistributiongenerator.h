@@ -3,8 +3,10 @@
 
 class NormalDistributionGenerator
 {
+    unsigned state;
     public:
-    double operator()() const;
+    NormalDistributionGenerator(const unsigned seed);
+    double operator()();
 };
 
 #endif
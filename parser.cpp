@@ -1,15 +1,21 @@
 #include <iostream>
-#include <sstream> // ostringstream
+#include <sstream> // ostringstream, istringstream
 #include <cctype>
+#include <mutex> // mutex, lock_guard
 #include <unistd.h> // getopt, optind, optarg
 
 #include "parser.h"
+#include "computationparams.h"
 #include "routines.h"
 
 using std::cout;
 using std::endl;
 using std::hex;
 using std::ostringstream;
+using std::istringstream;
+using std::getline;
+using std::lock_guard;
+using std::mutex;
 
 Parser::ParseError::ParseError(const string& msg):
     runtime_error(msg)
@@ -28,20 +34,101 @@ void Parser::PrintUsage()
 {
     cout << "Usage: transform-each-qubit-shmem ["
             "-n qubit_count "
-            "[-e epsilon] "
+            "[-e epsilon | epsilon1,epsilon2,... | first:last:step] "
             "[-i iteration_count] "
+            "[-m dense | product] "
+            "[-q] "
+            "[-g group_size] "
+            "[-a target_relative_standard_error] "
             "[-f fidelity_output_file] "
-            "[-t computation_time_output_file]"
-            "[-s stats_file]"
-        "]" << endl;
+            "[-t computation_time_output_file] "
+            "[-s stats_file] "
+            "[-j stats_json_file] "
+            "[-o out_of_core_dir] "
+            "[-c checkpoint_prefix [-k checkpoint_interval] [-r]] "
+            "[-C circuit_file] "
+            "[-T trace_file] "
+            "[-H hw_counters_file] "
+            "[-A autotune_profile] "
+            "[-z raw | float | lz | float-lz] "
+            "[-p]"
+        "] | [-J job_file [default_options]]" << endl;
 }
 
+/*
+    Accepts single value, comma separated list or range first:last:step
+    with both ends included.
+*/
+vector<double> Parser::ParseEpsilons(const string& s)
+{
+    vector<double> result;
+    if (s.find(':') != string::npos)
+    {
+        vector<double> range;
+        istringstream iss(s);
+        string token;
+        while (getline(iss, token, ':'))
+        {
+            range.push_back(string_to_number<double>(token));
+        }
+        if (range.size() != 3 || range[2] <= 0.0 || range[1] < range[0])
+        {
+            throw ParseError("Epsilon range must be first:last:step "
+                "with positive step and first <= last");
+        }
+        // tolerate rounding error when last is a multiple of step
+        const double tolerance = 1e-9;
+        const double steps = (range[1] - range[0]) / range[2] + tolerance;
+        if (steps >= max_epsilon_count)
+        {
+            ostringstream oss;
+            oss << "Epsilon range must not have more than "
+                << max_epsilon_count << " values";
+            throw ParseError(oss.str());
+        }
+        const int count = steps;
+        for (int i = 0; i <= count; i++)
+        {
+            result.push_back(range[0] + i * range[2]);
+        }
+    }
+    else
+    {
+        istringstream iss(s);
+        string token;
+        while (getline(iss, token, ','))
+        {
+            result.push_back(string_to_number<double>(token));
+        }
+        if (result.empty())
+        {
+            throw ParseError("Epsilon list is empty");
+        }
+        if (result.size() > Index(max_epsilon_count))
+        {
+            ostringstream oss;
+            oss << "Epsilon list must not have more than "
+                << max_epsilon_count << " values";
+            throw ParseError(oss.str());
+        }
+    }
+    return result;
+}
+
+/*
+    May be called several times and from several threads, getopt keeps
+    its state in globals.
+*/
 Args Parser::Parse()
 {
+    static mutex getopt_mutex;
+    lock_guard<mutex> lock(getopt_mutex);
+    optind = 0; // glibc restarts scanning of a new argv
+
     Args result;
     ostringstream oss;
     int c; // option character
-    while ((c = getopt(argc, argv, ":n:e:i:f:t:s:")) != -1)
+    while ((c = getopt(argc, argv, ":n:e:i:m:g:a:f:t:s:j:o:c:k:rpqJ:C:T:H:A:z:")) != -1)
     {
         switch(c)
         {
@@ -49,11 +136,38 @@ Args Parser::Parse()
                 result.qubit_count = string_to_number<int>(optarg);
                 break;
             case 'e':
-                result.epsilon = string_to_number<double>(optarg);
+                result.epsilons = ParseEpsilons(optarg);
                 break;
             case 'i':
                 result.iteration_count = string_to_number<int>(optarg);
                 break;
+            case 'm':
+                if (string(optarg) == "product")
+                {
+                    result.product_state = true;
+                }
+                else if (string(optarg) == "dense")
+                {
+                    result.product_state = false;
+                }
+                else
+                {
+                    oss << "Unknown initial state `" << optarg << "'.";
+                    throw ParseError(oss.str());
+                }
+                break;
+            case 'g':
+                result.group_size = string_to_number<int>(optarg);
+                if (result.group_size < 1 ||
+                    (result.group_size & (result.group_size - 1)))
+                {
+                    throw ParseError("Group size must be a power of two");
+                }
+                break;
+            case 'a':
+                result.target_relative_error =
+                    string_to_number<double>(optarg);
+                break;
             case 'f':
                 result.fidelity_filename = optarg;
                 break;
@@ -63,6 +177,54 @@ Args Parser::Parse()
             case 's':
                 result.stats_filename = optarg;
                 break;
+            case 'j':
+                result.stats_json_filename = optarg;
+                break;
+            case 'o':
+                result.out_of_core_dir = optarg;
+                break;
+            case 'c':
+                result.checkpoint_prefix = optarg;
+                break;
+            case 'k':
+                result.checkpoint_interval = string_to_number<int>(optarg);
+                if (result.checkpoint_interval < 1)
+                {
+                    throw ParseError("Checkpoint interval must be positive");
+                }
+                break;
+            case 'r':
+                result.restart = true;
+                break;
+            case 'p':
+                result.preflight = true;
+                break;
+            case 'q':
+                result.per_qubit_noise = true;
+                break;
+            case 'J':
+                result.job_filename = optarg;
+                break;
+            case 'C':
+                result.circuit_filename = optarg;
+                break;
+            case 'T':
+                result.trace_filename = optarg;
+                break;
+            case 'H':
+                result.hw_counters_filename = optarg;
+                break;
+            case 'A':
+                result.autotune_filename = optarg;
+                break;
+            case 'z':
+                if (!ExchangeCodec::FormatFromName(optarg,
+                    result.exchange_format))
+                {
+                    oss << "Unknown exchange format `" << optarg << "'.";
+                    throw ParseError(oss.str());
+                }
+                break;
             case ':':
                 oss << "Option -" << char(optopt) << " requires an argument.";
                 throw ParseError(oss.str());
@@ -87,10 +249,38 @@ Args Parser::Parse()
         throw ParseError("Extra non-option arguments found");
     }
 
+    // options of a job server are defaults, each job is checked alone
+    if (result.job_filename)
+    {
+        return result;
+    }
+
     if (result.qubit_count == -1)
     {
         throw ParseError("Number of qubits not specified");
     }
 
+    if (result.restart && !result.checkpoint_prefix)
+    {
+        throw ParseError("Restart requires checkpoint prefix");
+    }
+
+    if (result.qubit_count < 1)
+    {
+        throw ParseError("Number of qubits must be positive");
+    }
+
+    if (!result.product_state &&
+        result.qubit_count > ComputationParams::max_qubit_count)
+    {
+        oss << "Number of qubits must not exceed "
+            << ComputationParams::max_qubit_count << " for dense state.";
+        throw ParseError(oss.str());
+    }
+
+    result.circuit = result.circuit_filename ?
+        Circuit::Read(result.circuit_filename, result.qubit_count) :
+        Circuit::HadamardLayer(result.qubit_count);
+
     return result;
 }
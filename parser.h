@@ -23,6 +23,9 @@ class Parser
     };
 
     Parser(const int argc, char** const argv);
+    // each epsilon costs a noisy transform per iteration
+    static const int max_epsilon_count = 4096;
+    static vector<double> ParseEpsilons(const string& s);
     Args Parse();
     static void PrintUsage();
 };
@@ -0,0 +1,166 @@
+
+#ifdef DEBUG
+#include "debug.h"
+#endif
+
+#ifdef NORANDOM
+#include "basisvector1generator.h"
+#else
+#include "randomcomplexgenerator.h"
+#endif
+
+#include "productstateworker.h"
+#include "backend.h"
+#include "normaldistributiongenerator.h"
+#include "routines.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
+
+ProductStateWorker::ProductStateWorker(const Args& args):
+    ComputationBase(args),
+    qubits(args.QubitCount(), Vector(2))
+{
+
+}
+
+void ProductStateWorker::VectorInitRandom(const int round)
+{
+    PhaseTimer timer(Stats::phase_init);
+    #ifdef NORANDOM
+    (void) round;
+    for (auto& q: qubits)
+    {
+        q[0] = complexd(1.0, 0.0);
+        q[1] = complexd(0.0, 0.0);
+    }
+    #else
+    RandomComplexGenerator gen(RoundSeed(round, state_stream));
+    for (auto& q: qubits)
+    {
+        q[0] = gen();
+        q[1] = gen();
+        const complexd coef = 1.0 / sqrt(norm(q[0]) + norm(q[1]));
+        q[0] *= coef;
+        q[1] *= coef;
+    }
+    #endif
+}
+
+/*
+    Returns <(A_1 (x) ... (x) A_n) psi | (B_1 (x) ... (x) B_n) psi> which
+    is a product of single-qubit scalar products. Qubits without gates
+    contribute <psi_q | psi_q> = 1.
+*/
+complexd ProductStateWorker::ScalarProduct(const vector<Matrix>& A,
+    const vector<Matrix>& B) const
+{
+    complexd result(1.0, 0.0);
+    for (Index k = 0; k < qubits.size(); k++)
+    {
+        if (A[k].empty())
+        {
+            continue;
+        }
+        const Vector& q = qubits[k];
+        const Matrix& a = A[k];
+        const Matrix& b = B[k];
+        const complexd a0 = a[0][0] * q[0] + a[0][1] * q[1];
+        const complexd a1 = a[1][0] * q[0] + a[1][1] * q[1];
+        const complexd b0 = b[0][0] * q[0] + b[0][1] * q[1];
+        const complexd b1 = b[1][0] * q[0] + b[1][1] * q[1];
+        result *= conj(a0) * b0 + conj(a1) * b1;
+    }
+    return result;
+}
+
+/*
+    Computes one iteration on each process. Element [p * m + k] of the
+    result is fidelity computed by process p for k-th epsilon, where m is
+    number of epsilons.
+*/
+vector<double> ProductStateWorker::RunRound(const int round)
+{
+    #ifdef DEBUG
+    cout << INDENT(1) << "ProductStateWorker::RunRound()..." << endl;
+    #endif
+
+    VectorInitRandom(round);
+
+    const vector<double>& epsilons = args.Epsilons();
+    const Index m = epsilons.size();
+    vector<double> fidelity(Backend::NPes() * m, 0.0);
+    {
+        PhaseTimer timer(Stats::phase_compute);
+        NormalDistributionGenerator gen(RoundSeed(round, noise_stream));
+        vector<double> xi(NoiseCount());
+        for (auto& x: xi)
+        {
+            x = gen();
+        }
+
+        // without two-qubit gates the circuit is a single step
+        const vector<Matrix> ideal = args.CircuitSpec().Fuse(
+            NoiseMatrix(0.0)).front().single;
+        for (Index k = 0; k < m; k++)
+        {
+            const vector<Matrix> noisy = args.CircuitSpec().Fuse(
+                NoiseMatrices(epsilons[k], xi)).front().single;
+            const complexd sp = ScalarProduct(ideal, noisy);
+            fidelity[Backend::MyPe() * m + k] = norm(sp);
+        }
+    }
+
+    AllSum(fidelity);
+
+    #ifdef DEBUG
+    cout << INDENT(1) << "ProductStateWorker::RunRound() return" << endl;
+    #endif
+
+    return fidelity;
+}
+
+void ProductStateWorker::Run()
+{
+    #ifdef DEBUG
+    cout << "ProductStateWorker::Run()..." << endl;
+    #endif
+
+    const int rounds = (args.IterationCount() + Backend::NPes() - 1) /
+        Backend::NPes();
+
+    vector<RunningStats> no_stats;
+    const int first_round = CheckpointRestore(no_stats);
+
+    for (int i = first_round; i < rounds; i++)
+    {
+        Trace::SetRound(i);
+        RunRound(i);
+
+        CheckpointSave(i + 1, no_stats);
+
+        if (args.TargetRelativeErrorFlag() && ReceiveStopFlag())
+        {
+            break;
+        }
+    }
+
+    if (args.ComputationTimeWriteToFileFlag())
+    {
+        Stats::PhaseTimeSummary();
+    }
+
+    if (args.StatsJsonWriteToFileFlag())
+    {
+        Stats::JsonWriteToFile(args.StatsJsonFileName());
+    }
+
+    if (args.StatsWriteToFileFlag())
+    {
+        Stats::SumOverPes();
+    }
+
+    #ifdef DEBUG
+    cout << "ProductStateWorker::Run() return" << endl;
+    #endif
+}
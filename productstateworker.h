@@ -0,0 +1,28 @@
+#ifndef PRODUCTSTATEWORKER_H
+#define PRODUCTSTATEWORKER_H
+
+#include "computationbase.h"
+
+/*
+    Computes fidelity for initial state which is a product of random
+    single-qubit states. The state is kept in factored form so one
+    iteration takes O(n) operations and no communication. Every process
+    computes its own iteration, results of a round are summed up on all
+    processes.
+*/
+class ProductStateWorker: protected ComputationBase
+{
+    friend class Master;
+    // qubits[k] is state of k-th qubit
+    vector<Vector> qubits;
+    void VectorInitRandom(const int round);
+    complexd ScalarProduct(const vector<Matrix>& A, const vector<Matrix>& B)
+        const;
+    protected:
+    vector<double> RunRound(const int round);
+    public:
+    ProductStateWorker(const Args& args);
+    void Run();
+};
+
+#endif
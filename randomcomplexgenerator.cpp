@@ -1,4 +1,4 @@
-#include <stdlib.h> // rand
+#include <stdlib.h> // rand_r
 
 #include "randomcomplexgenerator.h"
 
@@ -17,10 +17,11 @@ double RandomComplexGenerator::random01d()
     return double (r) / 0xffffffff;
 }
 
-RandomComplexGenerator::RandomComplexGenerator()
+RandomComplexGenerator::RandomComplexGenerator(const unsigned seed)
 {
-    m_z = rand();
-    m_w = rand();
+    unsigned state = seed;
+    m_z = rand_r(&state);
+    m_w = rand_r(&state);
 }
 
 complexd RandomComplexGenerator::operator()()
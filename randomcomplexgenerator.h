@@ -9,7 +9,7 @@ class RandomComplexGenerator
     unsigned m_z;
     inline double random01d();
     public:
-    RandomComplexGenerator();
+    RandomComplexGenerator(const unsigned seed);
     complexd operator()();
 };
 
@@ -1,11 +1,14 @@
-#include <dislib.h>
 
 #ifdef DEBUG
 #include "debug.h"
 #endif
 
 #include "remoteworker.h"
-#include "shmem.h"
+#include "backend.h"
+#include "routines.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
 
 RemoteWorker::RemoteWorker(const Args& args):
     WorkerBase(args)
@@ -13,28 +16,29 @@ RemoteWorker::RemoteWorker(const Args& args):
 
 }
 
-void RemoteWorker::ReceiveMatrix()
+/*
+    Returns noise samples of own group. Samples of all groups come in one
+    broadcast, NoiseCount() consecutive values per group.
+*/
+vector<double> RemoteWorker::ReceiveNoise()
 {
     #ifdef DEBUG
-    cout << INDENT(1) << "RemoteWorker::ReceiveMatrix()..." << endl;
+    cout << INDENT(1) << "RemoteWorker::ReceiveNoise()..." << endl;
     #endif
 
-    for (auto& row: U)
+    const int count = NoiseCount();
+    vector<double> xi(params.GroupCount() * count);
     {
-        for (auto& elem: row)
-        {
-            vector<double> complex_array(2);
-            for (auto& x: complex_array)
-            {
-                shmem_double_toall(&x, master_rank);
-            }
-            elem = complexd(complex_array[0], complex_array[1]);
-        }
+        PhaseTimer timer(Stats::phase_broadcast);
+        Backend::DoubleToAll(xi.data(), xi.size(), master_rank);
     }
 
     #ifdef DEBUG
-    cout << INDENT(1) << "RemoteWorker::ReceiveMatrix() return" << endl;
+    cout << INDENT(1) << "RemoteWorker::ReceiveNoise() return" << endl;
     #endif
+
+    const auto first = xi.begin() + GroupOffset(count);
+    return vector<double>(first, first + count);
 }
 
 void RemoteWorker::Run()
@@ -43,33 +47,88 @@ void RemoteWorker::Run()
     cout << "RemoteWorker::Run()..." << endl;
     #endif
 
-    ShmemBarrierAll(); // timer_total
-    for (int i = 0; i < args.IterationCount(); i++)
+    const int group_count = params.GroupCount();
+    const int rounds = (args.IterationCount() + group_count - 1) /
+        group_count;
+    const vector<double>& epsilons = args.Epsilons();
+
+    vector<RunningStats> no_stats;
+    const int first_round = CheckpointRestore(no_stats);
+
+    Trace::SetRound(first_round);
+    VectorInitRandomBegin(RoundSeed(first_round, state_stream));
+    vector<double> sums(1, VectorInitRandomEnd());
+    sums = GroupAllSum(sums);
+    VectorNormalize(sums[GroupOffset(1)]);
+
+    for (int i = first_round; i < rounds; i++)
     {
-        ShmemBarrierAll(); // timer_init
-        VectorInitRandom();
-        ShmemBarrierAll(); // timer_init
+        Trace::SetRound(i);
+        const bool prefetch = i + 1 < rounds;
+        if (prefetch)
+        {
+            VectorInitRandomBegin(RoundSeed(i + 1, state_stream));
+        }
 
-        U = HadamardMatrix();
+        steps = args.CircuitSpec().Fuse(NoiseMatrix(0.0));
 
-        ShmemBarrierAll(); // timer_transform
-        ApplyOperatorToEachQubit();
-        ShmemBarrierAll(); // timer_transform
+        ApplyCircuit();
 
         SwapVectors();
-        ReceiveMatrix();
+        const vector<double> xi = ReceiveNoise();
+
+        sums.clear();
+        for (Index k = 0; k < epsilons.size(); k++)
+        {
+            if (k)
+            {
+                RestoreInitialState();
+            }
+
+            steps = args.CircuitSpec().Fuse(NoiseMatrices(epsilons[k], xi));
+
+            ApplyCircuit();
+
+            const complexd sp = ScalarProduct();
+            sums.push_back(sp.real());
+            sums.push_back(sp.imag());
+        }
 
-        ShmemBarrierAll(); // timer_transform
-        ApplyOperatorToEachQubit();
-        ShmemBarrierAll(); // timer_transform
+        if (prefetch)
+        {
+            sums.push_back(VectorInitRandomEnd());
+        }
+
+        const Index n = sums.size();
+        sums = GroupAllSum(sums);
+
+        if (prefetch)
+        {
+            VectorNormalize(sums[GroupOffset(n) + n - 1]);
+        }
+
+        CheckpointSave(i + 1, no_stats);
+
+        if (args.TargetRelativeErrorFlag() && ReceiveStopFlag())
+        {
+            break;
+        }
+    }
+
+    if (args.ComputationTimeWriteToFileFlag())
+    {
+        Stats::PhaseTimeSummary();
+    }
 
-        complexd  sp = ScalarProduct();
-        double real = sp.real();
-        double imag = sp.imag();
-        shmem_double_allsum(&real);
-        shmem_double_allsum(&imag);
+    if (args.StatsJsonWriteToFileFlag())
+    {
+        Stats::JsonWriteToFile(args.StatsJsonFileName());
+    }
+
+    if (args.StatsWriteToFileFlag())
+    {
+        Stats::SumOverPes();
     }
-    ShmemBarrierAll(); // timer_total
 
     #ifdef DEBUG
     cout << "RemoteWorker::Run() return" << endl;
@@ -5,7 +5,7 @@
 
 class RemoteWorker: protected WorkerBase
 {
-    void ReceiveMatrix();
+    vector<double> ReceiveNoise();
     public:
     RemoteWorker(const Args& args);
     void Run();
@@ -1,6 +1,7 @@
 #include "routines.h"
-#include "shmem.h"
-#include <dislib.h>
+#include "backend.h"
+#include "hwcounters.h"
+#include "timer.h"
 #include <time.h> // time
 #include <unistd.h> // getpid
 
@@ -18,45 +19,16 @@ using std::endl;
 using std::ostringstream;
 #endif
 
-void ShmemReceiveElem(int from, void* data, int sz)
+void AllSum(vector<double>& x)
 {
-    #ifdef DEBUG
-    cout << "::ShmemReceiveElem()..." << endl;
-    #endif
-    const IndexElemPair* p = (IndexElemPair*) data;
-    *(Shmem::receive_first + p->first) = p->second;
-    #ifdef DEBUG
-        cout << INDENT(1) << "Index = " << p->first
-            << ", Value = " << p->second << endl;
-        cout << "::ShmemReceiveElem() return" << endl;
-    #endif
-}
-
-void ShmemBarrierAll()
-{
-    #ifdef DEBUG
-    {
-        static int count = 0;
-        const int len = 2 * INDENT_WIDTH;
-        const char c = '-';
-        const string line (len, c);
-        cout
-            << line
-            << "barrier "
-            << setw(6)
-            << count
-            << line
-            << endl;
-
-        count++;
-    }
-    #endif
-
-    shmem_barrier_all();
+    PhaseTimer timer(Stats::phase_reduction);
+    Backend::DoubleAllSum(x.data(), x.size());
 }
 
 complexd ScalarProduct(const Vector& a, const Vector& b)
 {
+    HwCounters::Scope counters(HwCounters::kernel_scalar_product,
+        2.0 * a.size() * sizeof(complexd), 8.0 * a.size());
     complexd sum (0.0, 0.0);
     for (Index i = 0; i < a.size(); i++)
     {
@@ -111,7 +83,7 @@ unsigned GetUniqueSeed()
 
     // something like 0xpprrtttt
     const unsigned seed = ((pid % 0x100) * 0x100
-        + shmem_my_pe() % 0x100) * half + time(NULL) % half;
+        + Backend::MyPe() % 0x100) * half + time(NULL) % half;
 
     #ifdef DEBUG
     // convert seed to hex
@@ -127,3 +99,18 @@ unsigned GetUniqueSeed()
     #endif
     return seed;
 }
+
+/*
+    Finalizer of MurmurHash3 applied to combination of arguments, close
+    arguments give unrelated results
+*/
+unsigned MixSeed(const unsigned seed, const unsigned value)
+{
+    unsigned h = seed ^ (value * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
@@ -8,8 +8,8 @@
 using std::stringstream;
 using std::string;
 
-void ShmemReceiveElem(int from, void* data, int sz);
-void ShmemBarrierAll();
+// sums each element over all processes
+void AllSum(vector<double>& x);
 
 // for n = 2**m returns m
 template <class Integer>
@@ -35,5 +35,7 @@ complexd ScalarProduct(const Vector& a, const Vector& b);
 Matrix MatrixMultiply(const Matrix& A, const Matrix& B);
 // get seed based on current time, process pid and rank
 unsigned GetUniqueSeed();
+// derives independent seed from seed and value
+unsigned MixSeed(const unsigned seed, const unsigned value);
 
 #endif
@@ -0,0 +1,50 @@
+#include <cmath> // sqrt, fabs
+#include <limits> // numeric_limits
+
+#include "runningstats.h"
+
+using std::numeric_limits;
+
+RunningStats::RunningStats():
+    count(0),
+    mean(0.0),
+    m2(0.0)
+{
+
+}
+
+void RunningStats::Add(const double x)
+{
+    count++;
+    const double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+long long RunningStats::Count() const
+{
+    return count;
+}
+
+double RunningStats::Mean() const
+{
+    return mean;
+}
+
+// unbiased sample variance
+double RunningStats::Variance() const
+{
+    return (count > 1) ? m2 / (count - 1) : 0.0;
+}
+
+double RunningStats::StandardError() const
+{
+    return (count > 1) ? sqrt(Variance() / count) :
+        numeric_limits<double>::infinity();
+}
+
+double RunningStats::RelativeStandardError() const
+{
+    return (mean != 0.0) ? StandardError() / fabs(mean) :
+        numeric_limits<double>::infinity();
+}
@@ -0,0 +1,23 @@
+#ifndef RUNNINGSTATS_H
+#define RUNNINGSTATS_H
+
+/*
+    Online mean and variance (Welford's algorithm)
+*/
+class RunningStats
+{
+    long long count;
+    double mean;
+    double m2; // sum of squared deviations from mean
+
+    public:
+    RunningStats();
+    void Add(const double x);
+    long long Count() const;
+    double Mean() const;
+    double Variance() const;
+    double StandardError() const;
+    double RelativeStandardError() const;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Strong and weak scaling study of fidelity-* programs.
+
+Runs the program for every PE count, with the same number of qubits
+(strong scaling) and with one more qubit per doubling of PEs (weak
+scaling). Times come from -t, exchanged bytes from -j. For each run
+parallel efficiency against the smallest PE count and communication
+fraction (exchange, wait, broadcast and reduction over all phases, means
+over PEs) are written as CSV.
+
+With --baseline rows are compared with a CSV written by an earlier run,
+total seconds exceeding the baseline by more than --tolerance are
+flagged and the exit code is 1.
+
+    ./scaling.py release/fidelity-threads --pes 1,2,4 -n 20 -o now.csv
+    ./scaling.py release/fidelity-mpi --pes 2,4,8 -n 22 \\
+        --baseline before.csv
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+FIELDS = ["mode", "qubits", "pes", "total_seconds", "init_seconds",
+    "transform_seconds", "compute_seconds", "communication_seconds",
+    "communication_fraction", "exchange_bytes", "efficiency",
+    "baseline_seconds", "regression"]
+COMMUNICATION_PHASES = ["exchange", "wait", "broadcast", "reduction"]
+
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Strong and weak scaling study")
+    p.add_argument("binary", help="fidelity-* program")
+    p.add_argument("--pes", default="1,2,4",
+        help="comma separated PE counts, the first one is the reference")
+    p.add_argument("-n", "--qubits", type=int, default=20,
+        help="qubits of strong scaling and of the first weak scaling run")
+    p.add_argument("--mode", choices=["strong", "weak", "both"],
+        default="both")
+    p.add_argument("-i", "--iterations", type=int, default=5)
+    p.add_argument("-e", "--epsilon", default="0.01")
+    p.add_argument("--repeat", type=int, default=1,
+        help="runs per point, the fastest is kept")
+    p.add_argument("--launcher", default=None,
+        help="command before the program, {pes} is replaced by PE count; "
+        "default is mpirun -np {pes}, none for the threads backend")
+    p.add_argument("--options", default="",
+        help="further options of the program, e.g. '-C circuit.txt'")
+    p.add_argument("-o", "--output", default="-",
+        help="CSV file of results, - for standard output")
+    p.add_argument("--baseline", help="CSV written by an earlier study")
+    p.add_argument("--tolerance", type=float, default=0.1,
+        help="allowed relative slowdown against the baseline")
+    return p.parse_args()
+
+
+def run(args, qubits, pes, workdir):
+    """Runs the program once, returns times and counters"""
+    launcher = args.launcher
+    if launcher is None:
+        threads = "threads" in os.path.basename(args.binary)
+        launcher = "" if threads else "mpirun -np {pes}"
+    times = os.path.join(workdir, "t.txt")
+    stats = os.path.join(workdir, "j.json")
+    command = (shlex.split(launcher.format(pes=pes)) +
+        [os.path.abspath(args.binary), "-n", str(qubits),
+        "-e", args.epsilon, "-i", str(args.iterations), "-t", times,
+        "-j", stats, "-f", os.devnull] + shlex.split(args.options))
+    env = dict(os.environ, PE_COUNT=str(pes))
+    subprocess.run(command, env=env, cwd=workdir, check=True,
+        stdout=subprocess.DEVNULL)
+
+    with open(times) as f:
+        lines = f.read().split("\n")
+    # total, init and transform of the master, then phase min mean max
+    result = {
+        "total_seconds": float(lines[0]),
+        "init_seconds": float(lines[1]),
+        "transform_seconds": float(lines[2]),
+    }
+    phases = {}
+    for line in lines[3:]:
+        fields = line.split()
+        if len(fields) == 4:
+            phases[fields[0]] = float(fields[2])
+    communication = sum(phases.get(p, 0.0) for p in COMMUNICATION_PHASES)
+    result["compute_seconds"] = phases.get("compute", 0.0)
+    result["communication_seconds"] = communication
+    all_phases = sum(phases.values())
+    result["communication_fraction"] = (communication / all_phases
+        if all_phases else 0.0)
+    with open(stats) as f:
+        result["exchange_bytes"] = json.load(f)["total"]["exchange"]["bytes"]
+    return result
+
+
+def study(args, mode, pe_counts, workdir):
+    rows = []
+    for pes in pe_counts:
+        qubits = args.qubits
+        if mode == "weak":
+            qubits += int(round(math.log2(pes / pe_counts[0])))
+        runs = [run(args, qubits, pes, workdir) for _ in range(args.repeat)]
+        row = min(runs, key=lambda r: r["total_seconds"])
+        row.update(mode=mode, qubits=qubits, pes=pes)
+        reference = rows[0] if rows else row
+        ratio = reference["total_seconds"] / row["total_seconds"]
+        # strong scaling divides the work, weak scaling keeps it per PE
+        row["efficiency"] = (ratio * reference["pes"] / pes
+            if mode == "strong" else ratio)
+        rows.append(row)
+        print("# %s n=%d pes=%d total=%.6g efficiency=%.3f "
+            "communication=%.3f" % (mode, qubits, pes, row["total_seconds"],
+            row["efficiency"], row["communication_fraction"]),
+            file=sys.stderr)
+    return rows
+
+
+def compare(rows, baseline_file, tolerance):
+    """Marks rows slower than baseline, returns number of regressions"""
+    baseline = {}
+    with open(baseline_file) as f:
+        for b in csv.DictReader(f):
+            key = (b["mode"], int(b["qubits"]), int(b["pes"]))
+            baseline[key] = float(b["total_seconds"])
+    count = 0
+    for row in rows:
+        seconds = baseline.get((row["mode"], row["qubits"], row["pes"]))
+        row["baseline_seconds"] = "" if seconds is None else seconds
+        row["regression"] = int(seconds is not None and
+            row["total_seconds"] > seconds * (1.0 + tolerance))
+        if row["regression"]:
+            count += 1
+            print("# regression: %s n=%d pes=%d %.6g s, baseline %.6g s" %
+                (row["mode"], row["qubits"], row["pes"],
+                row["total_seconds"], seconds), file=sys.stderr)
+    return count
+
+
+def main():
+    args = parse_args()
+    pe_counts = [int(p) for p in args.pes.split(",")]
+    modes = ["strong", "weak"] if args.mode == "both" else [args.mode]
+    rows = []
+    with tempfile.TemporaryDirectory() as workdir:
+        for mode in modes:
+            rows += study(args, mode, pe_counts, workdir)
+
+    regressions = 0
+    if args.baseline:
+        regressions = compare(rows, args.baseline, args.tolerance)
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    writer = csv.DictWriter(out, FIELDS, extrasaction="ignore",
+        restval="")
+    writer.writeheader()
+    writer.writerows(rows)
+    if out is not sys.stdout:
+        out.close()
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,50 @@
+#ifndef STATEALLOCATOR_H
+#define STATEALLOCATOR_H
+
+#include <cstddef> // size_t
+
+#include "statememory.h"
+
+/*
+    Allocator of vector elements, delegates to StateMemory so that state
+    vectors may live in memory-mapped files
+*/
+template <class T>
+class StateAllocator
+{
+    public:
+    typedef T value_type;
+
+    StateAllocator()
+    {
+    }
+
+    template <class U>
+    StateAllocator(const StateAllocator<U>&)
+    {
+    }
+
+    T* allocate(const size_t n)
+    {
+        return static_cast<T*>(StateMemory::Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, const size_t n)
+    {
+        StateMemory::Free(p, n * sizeof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const StateAllocator<T>&, const StateAllocator<U>&)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const StateAllocator<T>&, const StateAllocator<U>&)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include <cerrno> // errno
+#include <cstring> // strerror
+#include <mutex> // lock_guard
+#include <new> // operator new
+#include <stdlib.h> // mkstemp
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <unistd.h> // ftruncate, unlink, close, sysconf
+
+#include "statememory.h"
+#include "nodeshm.h"
+
+using std::lock_guard;
+
+thread_local string StateMemory::directory;
+vector<StateMemory::Block> StateMemory::cache;
+mutex StateMemory::cache_mutex;
+
+StateMemory::MapError::MapError(const string& msg):
+    runtime_error(msg)
+{
+
+}
+
+void StateMemory::SetDirectory(const string& dir)
+{
+    directory = dir;
+}
+
+bool StateMemory::OutOfCore()
+{
+    return !directory.empty();
+}
+
+// kind of large blocks allocated now
+StateMemory::Kind StateMemory::CurrentKind()
+{
+    return OutOfCore() ? kind_file : NodeShm::Sharing() ? kind_arena :
+        kind_heap;
+}
+
+/*
+    Takes a cached block of the same size and kind. Blocks of other sizes
+    are released first as they belong to a finished job.
+*/
+void* StateMemory::Allocate(const size_t size)
+{
+    if (size < min_mapped_size)
+    {
+        return ::operator new(size);
+    }
+
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        for (auto it = cache.begin(); it != cache.end(); it++)
+        {
+            if (it->size == size && it->kind == CurrentKind())
+            {
+                void* p = it->p;
+                cache.erase(it);
+                return p;
+            }
+        }
+
+        vector<Block> kept;
+        for (auto& b: cache)
+        {
+            if (b.size == size)
+            {
+                kept.push_back(b);
+            }
+            else
+            {
+                Release(b);
+            }
+        }
+        cache.swap(kept);
+    }
+
+    if (OutOfCore())
+    {
+        return AllocateMapped(size);
+    }
+    void* p = NodeShm::ArenaAllocate(size);
+    return p ? p : ::operator new(size);
+}
+
+/*
+    Backing file is unlinked right away so it disappears when the process
+    exits, even abnormally.
+*/
+void* StateMemory::AllocateMapped(const size_t size)
+{
+    string name = directory + "/fidelity-XXXXXX";
+    const int fd = mkstemp(&name[0]);
+    if (fd == -1)
+    {
+        throw MapError("Cannot create " + name + ": " + strerror(errno));
+    }
+    unlink(name.c_str());
+
+    if (ftruncate(fd, size) == -1)
+    {
+        const string msg = strerror(errno);
+        close(fd);
+        throw MapError("Cannot resize " + name + ": " + msg);
+    }
+
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const string msg = strerror(errno);
+    close(fd); // mapping keeps the file
+    if (p == MAP_FAILED)
+    {
+        throw MapError("Cannot map " + name + ": " + msg);
+    }
+
+    madvise(p, size, MADV_SEQUENTIAL);
+    return p;
+}
+
+// files are known from the mode, arena blocks by their address
+void StateMemory::Free(void* p, const size_t size)
+{
+    if (size < min_mapped_size)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    const Kind kind = OutOfCore() ? kind_file :
+        NodeShm::ArenaContains(p) ? kind_arena : kind_heap;
+    const Block block = {p, size, kind};
+    lock_guard<mutex> lock(cache_mutex);
+    cache.push_back(block);
+}
+
+void StateMemory::Release(const Block& block)
+{
+    if (block.kind == kind_file)
+    {
+        munmap(block.p, block.size);
+    }
+    else if (block.kind == kind_arena)
+    {
+        NodeShm::ArenaFree(block.p);
+    }
+    else
+    {
+        ::operator delete(block.p);
+    }
+}
+
+void StateMemory::ReleaseCache()
+{
+    lock_guard<mutex> lock(cache_mutex);
+    for (auto& b: cache)
+    {
+        Release(b);
+    }
+    cache.clear();
+}
+
+void StateMemory::Prefetch(const void* p, const size_t size)
+{
+    if (!OutOfCore())
+    {
+        return;
+    }
+
+    // madvise needs page aligned address
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t first = (size_t) p / page * page;
+    const size_t last = (size_t) p + size;
+    madvise((void*) first, last - first, MADV_WILLNEED);
+}
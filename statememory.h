@@ -0,0 +1,65 @@
+#ifndef STATEMEMORY_H
+#define STATEMEMORY_H
+
+#include <cstddef> // size_t
+#include <mutex> // mutex
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+using std::mutex;
+using std::runtime_error;
+using std::size_t;
+using std::string;
+using std::vector;
+
+/*
+    Places large vectors in memory-mapped files when out-of-core mode is
+    on, so that state vectors may exceed RAM, else in the shared memory
+    arena of NodeShm when node peers exchange through it, or on the heap
+    when the arena is full. Large blocks are not given back when freed
+    but kept for vectors of the same size, so consecutive jobs with the
+    same number of qubits skip allocation and page faults.
+*/
+class StateMemory
+{
+    // set by each PE, empty means 'in memory'
+    static thread_local string directory;
+    enum Kind
+    {
+        kind_heap,
+        kind_file,
+        kind_arena
+    };
+    struct Block
+    {
+        void* p;
+        size_t size;
+        Kind kind;
+    };
+    // freed blocks of all PEs of the process
+    static vector<Block> cache;
+    static mutex cache_mutex;
+    static Kind CurrentKind();
+    static void* AllocateMapped(const size_t size);
+    static void Release(const Block& block);
+    public:
+    class MapError: public runtime_error
+    {
+        public:
+        MapError(const string& msg);
+    };
+    // smaller allocations always stay on the heap and are not cached
+    static const size_t min_mapped_size = 1 << 20;
+    // must be called before any vector is allocated
+    static void SetDirectory(const string& dir);
+    static bool OutOfCore();
+    static void* Allocate(const size_t size);
+    static void Free(void* p, const size_t size);
+    // called by backend on finalize, before NodeShm unmaps the arena
+    static void ReleaseCache();
+    // hint that the range will be accessed soon
+    static void Prefetch(const void* p, const size_t size);
+};
+
+#endif
@@ -1,12 +1,62 @@
+#include <algorithm> // copy, fill, min, max
+
+#include <fstream> // ofstream
+#include <iostream> // std::cout
+
 #include "stats.h"
+#include "backend.h"
+#include "computationbase.h"
+#include "nodeshm.h"
+#include "routines.h"
+
+using std::copy;
+using std::cout;
+using std::endl;
+using std::fill;
+using std::max;
+using std::min;
+using std::ofstream;
+using std::ostream;
 
-Index Stats::send_op_counter;
-Index Stats::send_data_counter;
+thread_local Index Stats::send_op_counter;
+thread_local Index Stats::send_data_counter;
+thread_local Index Stats::send_size_histogram[Stats::histogram_size];
+thread_local vector<double> Stats::partner_data;
+thread_local vector<double> Stats::partner_time;
+thread_local Index Stats::broadcast_op_counter;
+thread_local Index Stats::broadcast_data_counter;
+thread_local Index Stats::reduction_op_counter;
+thread_local Index Stats::reduction_data_counter;
+thread_local Index Stats::intra_node_data_counter;
+thread_local Index Stats::io_data_counter;
+thread_local double Stats::io_time;
+thread_local Index Stats::codec_raw_counter;
+thread_local Index Stats::codec_encoded_counter;
+thread_local double Stats::codec_encode_time;
+thread_local double Stats::codec_decode_time;
+thread_local double Stats::exchange_wait_time;
+thread_local double Stats::phase_time[Stats::phase_count];
 
 void Stats::ResetCounters()
 {
     send_op_counter = 0;
     send_data_counter = 0;
+    fill(send_size_histogram, send_size_histogram + histogram_size, 0);
+    partner_data.assign(Backend::NPes(), 0.0);
+    partner_time.assign(Backend::NPes(), 0.0);
+    broadcast_op_counter = 0;
+    broadcast_data_counter = 0;
+    reduction_op_counter = 0;
+    reduction_data_counter = 0;
+    intra_node_data_counter = 0;
+    io_data_counter = 0;
+    io_time = 0.0;
+    codec_raw_counter = 0;
+    codec_encoded_counter = 0;
+    codec_encode_time = 0.0;
+    codec_decode_time = 0.0;
+    exchange_wait_time = 0.0;
+    fill(phase_time, phase_time + phase_count, 0.0);
 }
 
 Index Stats::SendOpCounter()
@@ -19,12 +69,322 @@ Index Stats::SendDataCounter()
     return send_data_counter;
 }
 
-void Stats::SendOpCounterInc()
+void Stats::SendAdd(const Index size)
 {
     send_op_counter++;
+    send_data_counter += size;
+    send_size_histogram[size ? intlog2(size) : 0]++;
 }
 
-void Stats::SendDataCounterAdd(const Index size)
+void Stats::PartnerAdd(const int pe, const Index size, const double seconds)
 {
-    send_data_counter += size;
+    if (pe >= 0 && pe < (int) partner_data.size())
+    {
+        partner_data[pe] += size;
+        partner_time[pe] += seconds;
+    }
+}
+
+void Stats::BroadcastAdd(const Index size)
+{
+    broadcast_op_counter++;
+    broadcast_data_counter += size;
+}
+
+void Stats::ReductionAdd(const Index size)
+{
+    reduction_op_counter++;
+    reduction_data_counter += size;
+}
+
+Index Stats::IntraNodeDataCounter()
+{
+    return intra_node_data_counter;
+}
+
+Index Stats::InterNodeDataCounter()
+{
+    return send_data_counter - intra_node_data_counter;
+}
+
+void Stats::IntraNodeDataCounterAdd(const Index size)
+{
+    intra_node_data_counter += size;
+}
+
+Index Stats::IoDataCounter()
+{
+    return io_data_counter;
+}
+
+double Stats::IoTime()
+{
+    return io_time;
+}
+
+void Stats::IoAdd(const Index size, const double time)
+{
+    io_data_counter += size;
+    io_time += time;
+}
+
+double Stats::CodecRatio()
+{
+    return codec_encoded_counter ?
+        double(codec_raw_counter) / codec_encoded_counter : 1.0;
+}
+
+double Stats::CodecEncodeTime()
+{
+    return codec_encode_time;
+}
+
+double Stats::CodecDecodeTime()
+{
+    return codec_decode_time;
+}
+
+void Stats::CodecAdd(const Index raw_size, const Index encoded_size,
+    const double encode_time, const double decode_time)
+{
+    codec_raw_counter += raw_size;
+    codec_encoded_counter += encoded_size;
+    codec_encode_time += encode_time;
+    codec_decode_time += decode_time;
+}
+
+// counters stay below 2**53 so sums of doubles are exact
+void Stats::SumOverPes()
+{
+    vector<double> x = {
+        (double) send_op_counter,
+        (double) send_data_counter,
+        (double) intra_node_data_counter,
+        (double) io_data_counter,
+        io_time,
+        (double) codec_raw_counter,
+        (double) codec_encoded_counter,
+        codec_encode_time,
+        codec_decode_time
+    };
+    Backend::DoubleAllSum(x.data(), x.size());
+    send_op_counter = x[0];
+    send_data_counter = x[1];
+    intra_node_data_counter = x[2];
+    io_data_counter = x[3];
+    io_time = x[4];
+    codec_raw_counter = x[5];
+    codec_encoded_counter = x[6];
+    codec_encode_time = x[7];
+    codec_decode_time = x[8];
+}
+
+const char* Stats::PhaseName(const Phase phase)
+{
+    static const char* const names[phase_count] = {
+        "init",
+        "compute",
+        "exchange",
+        "wait",
+        "broadcast",
+        "reduction"
+    };
+    return names[phase];
+}
+
+double Stats::PhaseTime(const Phase phase)
+{
+    return phase_time[phase];
+}
+
+void Stats::PhaseTimeAdd(const Phase phase, const double seconds)
+{
+    phase_time[phase] += seconds;
+}
+
+void Stats::ExchangeWaitAdd(const double seconds)
+{
+    exchange_wait_time += seconds;
+}
+
+// times of all PEs are gathered to master, which alone summarizes them
+vector<double> Stats::PhaseTimeSummary()
+{
+    const int pes = Backend::NPes();
+    const vector<double> all = Backend::DoubleGather(phase_time, phase_count,
+        ComputationBase::master_rank);
+    if (all.empty())
+    {
+        return all;
+    }
+
+    vector<double> result;
+    for (int phase = 0; phase < phase_count; phase++)
+    {
+        double low = all[phase];
+        double high = all[phase];
+        double sum = 0.0;
+        for (int pe = 0; pe < pes; pe++)
+        {
+            const double t = all[pe * phase_count + phase];
+            low = min(low, t);
+            high = max(high, t);
+            sum += t;
+        }
+        result.push_back(low);
+        result.push_back(sum / pes);
+        result.push_back(high);
+    }
+    return result;
+}
+
+// writes ops, bytes and seconds of a kind of communication
+static void JsonWriteTraffic(ostream& s, const char* name,
+    const double* x)
+{
+    s << "\"" << name << "\": {\"ops\": " << x[0] << ", \"bytes\": "
+        << x[1] << ", \"seconds\": " << x[2] << "}";
+}
+
+/*
+    Writes seconds blocked on partners of exchanges and on the last PE of
+    collectives, x is a slot of JsonWriteToFile
+*/
+static void JsonWriteWait(ostream& s, const double* x)
+{
+    s << "\"wait\": {\"seconds\": " << x[9] << ", \"exchange_seconds\": "
+        << x[14] << ", \"collective_seconds\": " << x[9] - x[14] << "}, ";
+}
+
+// writes bytes before and after encoding and seconds spent on both ends
+static void JsonWriteCodec(ostream& s, const double* x)
+{
+    s << "\"codec\": {\"raw_bytes\": " << x[0] << ", \"encoded_bytes\": "
+        << x[1] << ", \"ratio\": " << (x[1] ? x[0] / x[1] : 1.0)
+        << ", \"encode_seconds\": " << x[2] << ", \"decode_seconds\": "
+        << x[3] << "}";
+}
+
+// writes nonzero buckets as [smallest size in bytes, count] pairs
+static void JsonWriteHistogram(ostream& s, const double* x, const int size)
+{
+    s << "\"send_size_histogram\": [";
+    bool first = true;
+    for (int k = 0; k < size; k++)
+    {
+        if (x[k])
+        {
+            s << (first ? "" : ", ") << "[" << (Index(1) << k) << ", "
+                << x[k] << "]";
+            first = false;
+        }
+    }
+    s << "]";
+}
+
+/*
+    Counters of each PE are gathered to master in one slot: traffic of
+    exchange, broadcast and reduction, wait seconds, exchange encoding,
+    wait seconds within exchanges, send size histogram, then bytes and
+    seconds per partner.
+*/
+void Stats::JsonWriteToFile(const string& filename)
+{
+    const int pes = Backend::NPes();
+    const int fixed_size = 15 + histogram_size;
+    const int slot_size = fixed_size + 2 * pes;
+    vector<double> x(slot_size, 0.0);
+    const double own[] = {
+        (double) send_op_counter,
+        (double) send_data_counter,
+        phase_time[phase_exchange],
+        (double) broadcast_op_counter,
+        (double) broadcast_data_counter,
+        phase_time[phase_broadcast],
+        (double) reduction_op_counter,
+        (double) reduction_data_counter,
+        phase_time[phase_reduction],
+        phase_time[phase_wait],
+        (double) codec_raw_counter,
+        (double) codec_encoded_counter,
+        codec_encode_time,
+        codec_decode_time,
+        exchange_wait_time
+    };
+    copy(own, own + 15, x.begin());
+    copy(send_size_histogram, send_size_histogram + histogram_size,
+        x.begin() + 15);
+    copy(partner_data.begin(), partner_data.end(), x.begin() + fixed_size);
+    copy(partner_time.begin(), partner_time.end(),
+        x.begin() + fixed_size + pes);
+    const vector<double> all = Backend::DoubleGather(x.data(), x.size(),
+        ComputationBase::master_rank);
+
+    if (Backend::MyPe() != ComputationBase::master_rank)
+    {
+        return;
+    }
+
+    vector<double> total(fixed_size, 0.0);
+    for (int pe = 0; pe < pes; pe++)
+    {
+        for (int i = 0; i < fixed_size; i++)
+        {
+            total[i] += all[pe * slot_size + i];
+        }
+    }
+
+    ofstream fs;
+    ostream& s = (filename == "-") ? cout : (fs.open(filename.c_str()), fs);
+    s.precision(15);
+    s << "{" << endl;
+    s << "  \"pe_count\": " << pes << "," << endl;
+    s << "  \"total\": {";
+    JsonWriteTraffic(s, "exchange", &total[0]);
+    s << ", ";
+    JsonWriteTraffic(s, "broadcast", &total[3]);
+    s << ", ";
+    JsonWriteTraffic(s, "reduction", &total[6]);
+    s << ", ";
+    JsonWriteWait(s, &total[0]);
+    JsonWriteCodec(s, &total[10]);
+    s << ", ";
+    JsonWriteHistogram(s, &total[15], histogram_size);
+    s << "}," << endl;
+
+    s << "  \"pes\": [" << endl;
+    for (int pe = 0; pe < pes; pe++)
+    {
+        const double* p = &all[pe * slot_size];
+        s << "    {\"pe\": " << pe << ", \"node\": " << NodeShm::Node(pe)
+            << ", ";
+        JsonWriteTraffic(s, "exchange", p);
+        s << ", ";
+        JsonWriteTraffic(s, "broadcast", p + 3);
+        s << ", ";
+        JsonWriteTraffic(s, "reduction", p + 6);
+        s << ", ";
+        JsonWriteWait(s, p);
+        JsonWriteCodec(s, p + 10);
+        s << ", ";
+        JsonWriteHistogram(s, p + 15, histogram_size);
+        s << ", \"partners\": [";
+        bool first = true;
+        for (int partner = 0; partner < pes; partner++)
+        {
+            const double bytes = p[fixed_size + partner];
+            const double seconds = p[fixed_size + pes + partner];
+            if (bytes)
+            {
+                s << (first ? "" : ", ") << "{\"pe\": " << partner
+                    << ", \"bytes\": " << bytes << ", \"seconds\": "
+                    << seconds << ", \"bytes_per_second\": "
+                    << (seconds > 0.0 ? bytes / seconds : 0.0) << "}";
+                first = false;
+            }
+        }
+        s << "]}" << (pe + 1 < pes ? "," : "") << endl;
+    }
+    s << "  ]" << endl;
+    s << "}" << endl;
 }
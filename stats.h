@@ -3,16 +3,94 @@
 
 #include "typedefs.h"
 
+#include <string>
+
+using std::string;
+
+// counters of the calling PE
 class Stats
 {
-    static Index send_op_counter;
-    static Index send_data_counter;
+    static thread_local Index send_op_counter;
+    static thread_local Index send_data_counter;
+    // sends whose size in bytes is in [2**k, 2**(k + 1)) for each k
+    static const int histogram_size = 64;
+    static thread_local Index send_size_histogram[histogram_size];
+    // bytes sent to and seconds spent exchanging with each PE
+    static thread_local vector<double> partner_data;
+    static thread_local vector<double> partner_time;
+    static thread_local Index broadcast_op_counter;
+    static thread_local Index broadcast_data_counter;
+    static thread_local Index reduction_op_counter;
+    static thread_local Index reduction_data_counter;
+    // part of send_data_counter which did not leave the node
+    static thread_local Index intra_node_data_counter;
+    // traffic of out-of-core vectors, time of passes over them
+    static thread_local Index io_data_counter;
+    static thread_local double io_time;
+    // ranges encoded for exchange and their encodings, see ExchangeCodec
+    static thread_local Index codec_raw_counter;
+    static thread_local Index codec_encoded_counter;
+    static thread_local double codec_encode_time;
+    static thread_local double codec_decode_time;
+    // part of wait spent in exchanges, the rest is spent in collectives
+    static thread_local double exchange_wait_time;
+    public:
+    /*
+        Phases of a run timed on each PE without synchronization. Wait is
+        time blocked until the partner of an exchange or the last PE of a
+        collective arrives, it is not counted in other phases.
+    */
+    enum Phase
+    {
+        phase_init,
+        phase_compute,
+        phase_exchange,
+        phase_wait,
+        phase_broadcast,
+        phase_reduction,
+        phase_count
+    };
+    private:
+    static thread_local double phase_time[phase_count];
     public:
     static void ResetCounters();
     static Index SendOpCounter();
     static Index SendDataCounter();
-    static void SendOpCounterInc();
-    static void SendDataCounterAdd(const Index size);
+    // one message of size bytes
+    static void SendAdd(const Index size);
+    static void PartnerAdd(const int pe, const Index size,
+        const double seconds);
+    // bytes received by the calling PE through collectives
+    static void BroadcastAdd(const Index size);
+    static void ReductionAdd(const Index size);
+    static Index IntraNodeDataCounter();
+    static Index InterNodeDataCounter();
+    static void IntraNodeDataCounterAdd(const Index size);
+    static Index IoDataCounter();
+    static double IoTime();
+    static void IoAdd(const Index size, const double time);
+    // raw to encoded bytes, 1 if nothing was encoded
+    static double CodecRatio();
+    static double CodecEncodeTime();
+    static double CodecDecodeTime();
+    static void CodecAdd(const Index raw_size, const Index encoded_size,
+        const double encode_time, const double decode_time);
+    // collective, replaces counters by their sums over all PEs
+    static void SumOverPes();
+    static const char* PhaseName(const Phase phase);
+    static double PhaseTime(const Phase phase);
+    static void PhaseTimeAdd(const Phase phase, const double seconds);
+    static void ExchangeWaitAdd(const double seconds);
+    /*
+        Collective, returns on master minimum, mean and maximum over PEs
+        of each phase, three values per phase, and nothing elsewhere
+    */
+    static vector<double> PhaseTimeSummary();
+    /*
+        Collective, master writes counters of each PE and their totals as
+        JSON, "-" means stdout. Call before SumOverPes.
+    */
+    static void JsonWriteToFile(const string& filename);
 };
 
 #endif
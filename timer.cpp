@@ -1,7 +1,6 @@
-#include <dislib.h> // shmem_time
-
 #include "timer.h"
-#include "routines.h"
+#include "backend.h"
+#include "trace.h"
 
 Timer::Timer():
     sum(0.0)
@@ -11,14 +10,12 @@ Timer::Timer():
 
 void Timer::Start()
 {
-    ShmemBarrierAll();
-    start = shmem_time();
+    start = Backend::Time();
 }
 
 void Timer::Stop()
 {
-    ShmemBarrierAll();
-    const double end = shmem_time();
+    const double end = Backend::Time();
     const double delta = end - start;
     sum += delta;
 }
@@ -27,3 +24,34 @@ double Timer::Total() const
 {
     return sum;
 }
+
+thread_local PhaseTimer* PhaseTimer::current = NULL;
+
+PhaseTimer::PhaseTimer(const Stats::Phase phase):
+    phase(phase),
+    start(Backend::Time()),
+    outer(current),
+    nested(0.0)
+{
+    current = this;
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    const double end = Backend::Time();
+    Stats::PhaseTimeAdd(phase, end - start - nested);
+    if (phase == Stats::phase_wait && outer &&
+        outer->phase == Stats::phase_exchange)
+    {
+        Stats::ExchangeWaitAdd(end - start - nested);
+    }
+    current = outer;
+    if (outer)
+    {
+        outer->nested += end - start;
+    }
+    if (Trace::Enabled())
+    {
+        Trace::Record(phase, start, end);
+    }
+}
@@ -1,6 +1,9 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include "stats.h"
+
+// accumulates time of the calling PE, does not synchronize
 class Timer
 {
     double start;
@@ -13,4 +16,22 @@ class Timer
     double Total() const;
 };
 
+/*
+    Adds time from construction to destruction to a phase of the calling
+    PE, records the interval if tracing is on. Time of a nested timer is
+    not counted by the enclosing one, so phases add up to the total.
+*/
+class PhaseTimer
+{
+    static thread_local PhaseTimer* current;
+    const Stats::Phase phase;
+    const double start;
+    PhaseTimer* const outer;
+    double nested;
+
+    public:
+    PhaseTimer(const Stats::Phase phase);
+    ~PhaseTimer();
+};
+
 #endif
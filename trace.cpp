@@ -0,0 +1,132 @@
+#include <fstream> // ofstream
+#include <iomanip> // fixed, setprecision
+#include <iostream> // std::cerr
+
+#include "trace.h"
+#include "backend.h"
+#include "computationbase.h"
+#include "nodeshm.h"
+
+using std::cerr;
+using std::endl;
+using std::fixed;
+using std::ofstream;
+using std::setprecision;
+
+thread_local bool Trace::enabled = false;
+thread_local vector<Trace::Event> Trace::events;
+thread_local Index Trace::dropped;
+thread_local double Trace::origin;
+thread_local int Trace::round;
+thread_local int Trace::qubit;
+
+const Index Trace::capacity = Index(1) << 18;
+
+// fields of an event gathered as doubles
+static const int event_size = 5;
+
+void Trace::Start()
+{
+    events.clear();
+    events.reserve(capacity);
+    dropped = 0;
+    round = 0;
+    qubit = 0;
+    Backend::BarrierAll();
+    origin = Backend::Time();
+    enabled = true;
+}
+
+bool Trace::Enabled()
+{
+    return enabled;
+}
+
+void Trace::SetRound(const int round)
+{
+    Trace::round = round;
+}
+
+void Trace::SetQubit(const int qubit)
+{
+    Trace::qubit = qubit;
+}
+
+void Trace::Record(const Stats::Phase phase, const double begin,
+    const double end)
+{
+    if (events.size() == capacity)
+    {
+        dropped++;
+        return;
+    }
+    const Event e = {phase, begin - origin, end - origin, round, qubit};
+    events.push_back(e);
+}
+
+/*
+    Event counts and then events of all PEs are gathered to master. Times
+    are written in microseconds.
+*/
+void Trace::WriteToFile(const string& filename)
+{
+    enabled = false;
+    const int pes = Backend::NPes();
+    const int master_rank = ComputationBase::master_rank;
+    const bool master = Backend::MyPe() == master_rank;
+
+    const double own_counts[2] = {double(events.size()), double(dropped)};
+    const vector<double> counts = Backend::DoubleGather(own_counts, 2,
+        master_rank);
+    vector<double> x(events.size() * event_size);
+    for (Index i = 0; i < events.size(); i++)
+    {
+        const Event& e = events[i];
+        x[i * event_size] = e.phase;
+        x[i * event_size + 1] = e.begin;
+        x[i * event_size + 2] = e.end;
+        x[i * event_size + 3] = e.round;
+        x[i * event_size + 4] = e.qubit;
+    }
+    const vector<double> all = Backend::DoubleGather(x.data(), x.size(),
+        master_rank);
+
+    if (master)
+    {
+        ofstream fs(filename.c_str());
+        if (!fs)
+        {
+            cerr << "Cannot open trace file " << filename << endl;
+        }
+        fs << fixed << setprecision(3);
+        fs << "{\"traceEvents\":[" << endl;
+
+        const double* e = all.data();
+        Index total_dropped = 0;
+        for (int pe = 0; pe < pes; pe++)
+        {
+            fs << (pe ? ",\n" : "") << "{\"name\":\"thread_name\","
+                "\"ph\":\"M\",\"pid\":" << NodeShm::Node(pe) <<
+                ",\"tid\":" << pe << ",\"args\":{\"name\":\"PE " << pe <<
+                "\"}}";
+            const Index count = counts[2 * pe];
+            total_dropped += counts[2 * pe + 1];
+            for (Index i = 0; i < count; i++, e += event_size)
+            {
+                fs << ",\n{\"name\":\""
+                    << Stats::PhaseName(Stats::Phase(int(e[0])))
+                    << "\",\"ph\":\"X\",\"pid\":" << NodeShm::Node(pe)
+                    << ",\"tid\":" << pe
+                    << ",\"ts\":" << e[1] * 1e6
+                    << ",\"dur\":" << (e[2] - e[1]) * 1e6
+                    << ",\"args\":{\"round\":" << int(e[3])
+                    << ",\"qubit\":" << int(e[4]) << "}}";
+            }
+        }
+        fs << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":"
+            "{\"dropped_events\":" << total_dropped << "}}" << endl;
+    }
+
+    events.clear();
+    events.shrink_to_fit();
+}
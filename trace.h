@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+
+#include "stats.h"
+#include "typedefs.h"
+
+using std::string;
+using std::vector;
+
+/*
+    Timeline of phases of the calling PE, enabled with -T. Events are
+    kept in a buffer allocated when tracing starts, events beyond its
+    capacity are dropped and counted. Events of all PEs are written as
+    Chrome trace event JSON which browser-based viewers such as Perfetto
+    open, one track per PE.
+*/
+class Trace
+{
+    struct Event
+    {
+        Stats::Phase phase;
+        double begin;
+        double end;
+        int round;
+        int qubit;
+    };
+    static thread_local bool enabled;
+    static thread_local vector<Event> events;
+    static thread_local Index dropped;
+    // time of Start, the same moment on all PEs
+    static thread_local double origin;
+    static thread_local int round;
+    static thread_local int qubit;
+    public:
+    // events per PE
+    static const Index capacity;
+    // collective, clears the buffer and aligns time origin of PEs
+    static void Start();
+    static bool Enabled();
+    // round of following events, each group computes one iteration per round
+    static void SetRound(const int round);
+    // target qubit of following events, 0 means none
+    static void SetQubit(const int qubit);
+    static void Record(const Stats::Phase phase, const double begin,
+        const double end);
+    // collective, master writes events of all PEs and tracing stops
+    static void WriteToFile(const string& filename);
+};
+
+#endif
@@ -5,12 +5,14 @@
 #include <vector>
 #include <utility> // std::pair
 
+#include "stateallocator.h"
+
 using std::vector;
 using std::complex;
 using std::pair;
 
 typedef complex<double> complexd;
-typedef vector<complexd> Vector;
+typedef vector<complexd, StateAllocator<complexd> > Vector;
 typedef Vector::size_type Index;
 typedef vector<Vector> Matrix;
 typedef pair<Index, complexd> IndexElemPair;
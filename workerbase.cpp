@@ -1,8 +1,8 @@
-#include <algorithm> // generate, copy
-#include <dislib.h>
+#include <algorithm> // generate, copy, min
+#include <future> // async
 
 #ifdef DEBUG
-#include "debug.h"
+#include "eventlog.h"
 #endif
 
 #ifdef NORANDOM
@@ -12,131 +12,560 @@
 #endif
 
 #include "workerbase.h"
+#include "backend.h"
 #include "applyoperator.h"
+#include "exchangecodec.h"
+#include "hwcounters.h"
+#include "nodeshm.h"
 #include "routines.h"
-#include "shmem.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
 
+using std::async;
 using std::copy;
+using std::launch;
+using std::max;
+using std::min;
 
 WorkerBase::WorkerBase(const Args& args):
-    ComputationBase(args)
+    ComputationBase(args),
+    params(args)
 {
-    psi.resize(params.WorkerVectorSize());
-    buffer.resize(psi.size() / 2);
+    psi.resize(LocalVectorSize());
+    if (Backend::exchange_needs_buffer)
+    {
+        buffer.resize(psi.size() / 2);
+    }
+}
+
+// idle processes keep empty vectors
+Index WorkerBase::LocalVectorSize() const
+{
+    return params.Idle() ? 0 : params.WorkerVectorSize();
+}
+
+// bytes taken by vectors of one process
+Index WorkerBase::MemoryPerRank(const Args& args,
+    const Index worker_vector_size)
+{
+    // psi, psi_noiseless, psi_next and optional psi_initial
+    const Index vector_count = (args.Epsilons().size() > 1) ? 4 : 3;
+    const Index half = worker_vector_size / 2;
+    const Index buffer_size = Backend::exchange_needs_buffer ? half : 0;
+    Index elem_count = vector_count * worker_vector_size + buffer_size;
+    // encodings sent and received by ExchangeRange
+    const ExchangeCodec::Format format = args.ExchangeFormat();
+    if (format != ExchangeCodec::format_raw)
+    {
+        const Index encoded_size = ExchangeCodec::EncodedSizeBound(format,
+            half);
+        elem_count += Backend::exchange_needs_buffer ? 2 * encoded_size :
+            encoded_size;
+    }
+    return elem_count * sizeof(complexd) +
+        ExchangeCodec::ScratchBytes(format, half);
 }
 
 complexd WorkerBase::ScalarProduct() const
 {
+  PhaseTimer timer(Stats::phase_compute);
   return ::ScalarProduct(psi, psi_noiseless);
 }
 
-void WorkerBase::VectorInitRandom()
+/*
+    Starts generation of random state for the next iteration. Generation
+    runs in a separate thread and does not communicate so it overlaps with
+    the transform of the current iteration.
+*/
+void WorkerBase::VectorInitRandomBegin(const unsigned state_seed)
 {
-    #ifdef DEBUG
-    cout << INDENT(1) << "WorkerBase::VectorInitRandom()..." << endl;
-    #endif
-
     #ifdef NORANDOM
-    BasisVector1Generator gen;
+    BasisVector1Generator gen(params.GroupRank() == 0);
+    (void) state_seed;
     #else
-    RandomComplexGenerator gen;
+    RandomComplexGenerator gen(state_seed);
     #endif
 
-    generate(psi.begin(), psi.end(), gen);
-    NormalizeGlobal();
-
-    psi_noiseless = psi;
+    psi_next.resize(LocalVectorSize());
+    HwCounters::Totals* const totals = HwCounters::PeTotals();
+    psi_next_ready = async(launch::async, [this, gen, totals]() mutable
+        {
+            // generated elements are written once
+            HwCounters::Scope counters(HwCounters::kernel_init,
+                psi_next.size() * sizeof(complexd), 0.0, totals);
+            generate(psi_next.begin(), psi_next.end(), gen);
+        });
 
     #ifdef DEBUG
-    cout << INDENT(1) << "WorkerBase::VectorInitRandom() return" << endl;
+    EventLog::Record(EventLog::worker_random_begin);
     #endif
 }
 
-void WorkerBase::NormalizeGlobal()
+/*
+    Waits for the state started by VectorInitRandomBegin and makes it
+    current. Returns local part of the squared norm, the state must be
+    passed to VectorNormalize once global sum is known.
+*/
+double WorkerBase::VectorInitRandomEnd()
 {
+    PhaseTimer timer(Stats::phase_init);
+    psi_next_ready.get();
+    psi.swap(psi_next);
+
+    HwCounters::Scope counters(HwCounters::kernel_normalize,
+        psi.size() * sizeof(complexd), 4.0 * psi.size());
     double sum = 0.0;
     for (auto x: psi)
     {
         sum += norm(x);
     }
 
-    shmem_double_allsum(&sum);
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_random_end);
+    #endif
+
+    return sum;
+}
 
+void WorkerBase::VectorNormalize(const double sum)
+{
+    PhaseTimer timer(Stats::phase_init);
     const complexd coef = 1.0 / sqrt(sum);
-    // multiply each element by coef
-    for (auto &x: psi)
     {
-        x *= coef;
+        HwCounters::Scope counters(HwCounters::kernel_normalize,
+            2.0 * psi.size() * sizeof(complexd), 6.0 * psi.size());
+        // multiply each element by coef
+        for (auto &x: psi)
+        {
+            x *= coef;
+        }
+    }
+
+    psi_noiseless = psi;
+
+    if (args.Epsilons().size() > 1)
+    {
+        psi_initial = psi;
+    }
+}
+
+/*
+    Sums local values over processes of each group. Values of group j are
+    placed at [j * n, (j + 1) * n) where n is size of local.
+*/
+vector<double> WorkerBase::GroupAllSum(const vector<double>& local) const
+{
+    const Index n = local.size();
+    vector<double> result(params.GroupCount() * n, 0.0);
+    if (!params.Idle())
+    {
+        copy(local.begin(), local.end(), result.begin() + params.Group() * n);
     }
+    AllSum(result);
+    return result;
 }
 
-void WorkerBase::ApplyOperator()
+// position of own group values in result of GroupAllSum
+Index WorkerBase::GroupOffset(const Index count) const
+{
+    return params.Idle() ? 0 : params.Group() * count;
+}
+
+void WorkerBase::RestoreInitialState()
+{
+    psi = psi_initial;
+}
+
+void WorkerBase::ApplyOperator(const Matrix& U)
 {
     #ifdef DEBUG
-    cout << INDENT(2) << "WorkerBase::ApplyOperator()..." << endl;
-    params.PrintAll();
+    EventLog::Record(EventLog::worker_apply_operator_begin);
+    params.RecordTarget();
     #endif
 
+    // idle processes only take part in synchronization
     if (params.TargetQubitIsGlobal())
     {
-        SwapWithPartner();
-        ::ApplyOperator(psi, U, params.WorkerTargetQubit());
-        SwapWithPartner();
+        const Index msb = params.WorkerVectorSize() / 2;
+        SwapWithPartner(params.PartnerRank(), params.TargetQubitValue(), msb,
+            0, true);
+        if (!params.Idle())
+        {
+            ::ApplyOperator(psi, U, params.WorkerTargetQubit());
+        }
+        SwapWithPartner(params.PartnerRank(), params.TargetQubitValue(), msb,
+            0, true);
     }
-    else
+    else if (!params.Idle())
     {
         ::ApplyOperator(psi, U, params.WorkerTargetQubit());
     }
 
     #ifdef DEBUG
-    cout << INDENT(2) << "WorkerBase::ApplyOperator()... return" << endl;
+    EventLog::Record(EventLog::worker_apply_operator_end);
     #endif
 }
 
-void WorkerBase::ApplyOperatorToEachQubit()
+WorkerBase::QubitPlace WorkerBase::Place(const int qubit)
+{
+    params.SetTargetQubit(qubit);
+    QubitPlace result = {params.TargetQubitIsGlobal(), 0, 0, 0};
+    if (result.global)
+    {
+        result.value = params.TargetQubitValue();
+        result.partner_rank = params.PartnerRank();
+    }
+    else
+    {
+        result.mask = params.WorkerVectorSize() >> params.WorkerTargetQubit();
+    }
+    return result;
+}
+
+/*
+    Applies fused gates of each step. Global qubits without gates need no
+    exchange, qubits within a block are left for one blocked pass.
+*/
+void WorkerBase::ApplyCircuit()
 {
     #ifdef DEBUG
-    cout << INDENT(1) << "WorkerBase::ApplyOperatorToEachQubit()..." << endl;
+    EventLog::Record(EventLog::worker_apply_circuit_begin);
+    #endif
+
+    // passes over the vector are computed, exchanges and waits are not
+    const double start = Stats::PhaseTime(Stats::phase_compute);
+    Index pass_count = 0;
+    for (auto& step: steps)
+    {
+        ApplySingle(step.single, pass_count);
+        Trace::SetQubit(step.qubit);
+        if (step.qubit && step.controlled)
+        {
+            ApplyControlled(step.U, step.qubit, step.second);
+            pass_count++;
+        }
+        else if (step.qubit)
+        {
+            ApplyTwoQubit(step.U, step.qubit, step.second);
+            pass_count++;
+        }
+    }
+
+    Trace::SetQubit(0);
+
+    if (StateMemory::OutOfCore())
+    {
+        // each pass reads and writes the whole vector
+        Stats::IoAdd(2 * pass_count * psi.size() * sizeof(complexd),
+            Stats::PhaseTime(Stats::phase_compute) - start);
+    }
+
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_apply_circuit_end);
     #endif
+}
+
+void WorkerBase::ApplySingle(const vector<Matrix>& single,
+    Index& pass_count)
+{
+    const Index block_size = min(BlockSize(), params.WorkerVectorSize());
+    vector<Matrix> blocked(intlog2(block_size));
+    bool blocked_pass = false;
 
     for (int target_qubit = 1; target_qubit <= args.QubitCount();
         target_qubit++)
     {
+        const Matrix& U = single[target_qubit - 1];
+        if (U.empty())
+        {
+            continue;
+        }
         params.SetTargetQubit(target_qubit);
-        ApplyOperator();
+        const Index mask = params.WorkerVectorSize() >>
+            params.WorkerTargetQubit();
+        if (params.TargetQubitIsGlobal() || mask >= block_size)
+        {
+            Trace::SetQubit(target_qubit);
+            ApplyOperator(U);
+            pass_count++;
+        }
+        else
+        {
+            blocked[intlog2(mask)] = U;
+            blocked_pass = true;
+        }
+    }
+
+    if (blocked_pass)
+    {
+        Trace::SetQubit(0);
+        if (!params.Idle())
+        {
+            ::ApplyOperatorBlocked(psi, blocked, block_size);
+        }
+        pass_count++;
+    }
+}
+
+/*
+    Elements with control unset are left alone. If control is global,
+    ranks with control unset neither compute nor exchange. If only target
+    is global, elements with control set are exchanged, half of what an
+    uncontrolled gate sends.
+*/
+void WorkerBase::ApplyControlled(const Matrix& U, const int target_qubit,
+    const int control_qubit)
+{
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_apply_controlled_begin, target_qubit,
+        control_qubit);
+    #endif
+
+    const QubitPlace t = Place(target_qubit);
+    const QubitPlace c = Place(control_qubit);
+    const Index msb = params.WorkerVectorSize() / 2;
+    const bool compute = !params.Idle() && (!c.global || c.value);
+
+    if (!t.global)
+    {
+        if (compute)
+        {
+            ::ApplyControlledOperator(psi, U, c.mask, t.mask);
+        }
+    }
+    else if (c.global || c.mask != msb || msb > 1)
+    {
+        // target is exchanged into pivot, another local qubit than control
+        const Index pivot = (c.mask != msb) ? msb : msb / 2;
+        SwapWithPartner(t.partner_rank, t.value, pivot, c.mask, compute);
+        if (compute)
+        {
+            ::ApplyControlledOperator(psi, U, c.mask, pivot);
+        }
+        SwapWithPartner(t.partner_rank, t.value, pivot, c.mask, compute);
+    }
+    else
+    {
+        /*
+            Control is the only local qubit. It becomes the value of
+            target on each rank of the pair once halves are exchanged.
+        */
+        SwapWithPartner(t.partner_rank, t.value, msb, 0, true);
+        if (!params.Idle() && t.value)
+        {
+            ::ApplyControlledOperator(psi, U, 0, msb);
+        }
+        SwapWithPartner(t.partner_rank, t.value, msb, 0, true);
     }
 
     #ifdef DEBUG
-    cout << INDENT(1) << "WorkerBase::ApplyOperatorToEachQubit() return"
-        << endl;
+    EventLog::Record(EventLog::worker_apply_controlled_end);
     #endif
 }
 
+/*
+    Global qubits are exchanged into local pivot qubits first, which takes
+    at least two local qubits if both are global or the other one is the
+    most significant local qubit.
+*/
+void WorkerBase::ApplyTwoQubit(const Matrix& U, const int first_qubit,
+    const int second_qubit)
+{
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_apply_two_qubit_begin, first_qubit,
+        second_qubit);
+    #endif
+
+    const QubitPlace a = Place(first_qubit);
+    const QubitPlace b = Place(second_qubit);
+    const Index msb = params.WorkerVectorSize() / 2;
+
+    if (!a.global && !b.global)
+    {
+        if (!params.Idle())
+        {
+            ::ApplyTwoQubitOperator(psi, U, a.mask, b.mask);
+        }
+    }
+    else if (a.global && b.global)
+    {
+        SwapWithPartner(a.partner_rank, a.value, msb, 0, true);
+        SwapWithPartner(b.partner_rank, b.value, msb / 2, 0, true);
+        if (!params.Idle())
+        {
+            ::ApplyTwoQubitOperator(psi, U, msb, msb / 2);
+        }
+        SwapWithPartner(b.partner_rank, b.value, msb / 2, 0, true);
+        SwapWithPartner(a.partner_rank, a.value, msb, 0, true);
+    }
+    else
+    {
+        const QubitPlace& g = a.global ? a : b;
+        const Index local_mask = a.global ? b.mask : a.mask;
+        const Index pivot = (local_mask != msb) ? msb : msb / 2;
+        SwapWithPartner(g.partner_rank, g.value, pivot, 0, true);
+        if (!params.Idle())
+        {
+            ::ApplyTwoQubitOperator(psi, U, a.global ? pivot : a.mask,
+                b.global ? pivot : b.mask);
+        }
+        SwapWithPartner(g.partner_rank, g.value, pivot, 0, true);
+    }
+
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_apply_two_qubit_end);
+    #endif
+}
+
+// elements transformed together by ApplyOperatorBlocked
+const Index WorkerBase::default_block_size = Index(1) << 15;
+thread_local Index WorkerBase::block_size = 0;
+
+Index WorkerBase::BlockSize()
+{
+    // in-core blocks fit in cache, out-of-core blocks amortize I/O latency
+    if (StateMemory::OutOfCore())
+    {
+        return Index(1) << 22;
+    }
+    return block_size ? block_size : default_block_size;
+}
+
+void WorkerBase::SetBlockSize(const Index block_size)
+{
+    WorkerBase::block_size = block_size;
+}
+
 void WorkerBase::SwapVectors()
 {
   psi.swap(psi_noiseless);
 }
 
-void WorkerBase::SwapWithPartner()
+/*
+    Exchanges elements whose pivot bit differs from value, and whose
+    control bit is set if control_mask is not 0, with the same elements of
+    partner. Afterwards pivot bit of those elements is the value of the
+    global qubit while value is the former pivot bit. Inactive ranks and
+    their partners send nothing but still take part in synchronization.
+*/
+void WorkerBase::SwapWithPartner(const int partner_rank, const int value,
+    const Index pivot_mask, const Index control_mask, const bool active)
 {
     #ifdef DEBUG
-    cout << INDENT(3) << "WorkerBase::SwapWithPartner()..." << endl;
+    EventLog::Record(EventLog::worker_swap_begin, partner_rank, pivot_mask);
     #endif
 
-    const auto middle = psi.begin() + psi.size() / 2;
-    const auto begin = params.TargetQubitValue() ? psi.begin() : middle;
-    const auto end = params.TargetQubitValue() ? middle : psi.end();
+    const Index half = psi.size() / 2;
+    if (pivot_mask == half && !control_mask)
+    {
+        const auto middle = psi.begin() + half;
+        const auto begin = value ? psi.begin() : middle;
+        const auto end = !active ? begin : value ? middle : psi.end();
+        PhaseTimer timer(Stats::phase_exchange);
+        ExchangeRange(begin, end, partner_rank);
+    }
+    else
+    {
+        // elements are scattered, they are sent from a contiguous copy
+        PhaseTimer timer(Stats::phase_exchange);
+        const Index pivot_value = value ? 0 : pivot_mask;
+        gathered.clear();
+        for (Index i = 0; active && i < psi.size(); i++)
+        {
+            if ((i & pivot_mask) == pivot_value &&
+                (i & control_mask) == control_mask)
+            {
+                gathered.push_back(psi[i]);
+            }
+        }
+        ExchangeRange(gathered.begin(), gathered.end(), partner_rank);
+        auto it = gathered.begin();
+        for (Index i = 0; active && i < psi.size(); i++)
+        {
+            if ((i & pivot_mask) == pivot_value &&
+                (i & control_mask) == control_mask)
+            {
+                psi[i] = *it++;
+            }
+        }
+    }
+
+    #ifdef DEBUG
+    EventLog::Record(EventLog::worker_swap_end);
+    #endif
+}
 
-    Shmem::SetReceiveVector(buffer.begin());
+/*
+    Ranges sent off the node are encoded unless the format is raw.
+    Encodings differ in length, so partners first swap their lengths
+    and then as many elements as the longer one has. An encoding not
+    shorter than its range is flagged in the length, then both partners
+    send their ranges raw. All PEs make the same backend calls, those
+    with nothing to encode send empty ranges.
+*/
+void WorkerBase::ExchangeRange(const Vector::iterator& first,
+    const Vector::iterator& last, const int partner_rank)
+{
+    const Index count = last - first;
+    const bool encode = count && !NodeShm::SameNode(partner_rank) &&
+        ExchangeCodec::CurrentFormat() != ExchangeCodec::format_raw;
+    double start = Backend::Time();
+    if (ExchangeCodec::CurrentFormat() == ExchangeCodec::format_raw)
+    {
+        Backend::ExchangeWithPartner(first, last, buffer.begin(),
+            partner_rank);
+        Stats::PartnerAdd(partner_rank, count * sizeof(complexd),
+            Backend::Time() - start);
+        return;
+    }
 
-    // make sure partner is ready to receive before sending
-    ShmemBarrierAll();
+    const Index encoded_size = encode ?
+        ExchangeCodec::Encode(first, count, encoded) : 0;
+    const double encode_time = Backend::Time() - start;
 
-    Shmem::SendVector(begin, end, params.PartnerRank());
-    ShmemBarrierAll();
-    copy(buffer.begin(), buffer.end(), begin);
+    start = Backend::Time();
+    const bool raw = encoded_size >= count;
+    Vector length(encode ? 1 : 0, complexd(encoded_size, raw));
+    Vector length_buffer(length.size());
+    Backend::ExchangeWithPartner(length.begin(), length.end(),
+        length_buffer.begin(), partner_rank);
+    const bool encoded_both = encode && !raw && !length.front().imag();
+    const Index size = encoded_both ?
+        max(encoded_size, Index(length.front().real())) : 0;
+    if (encoded.size() < size)
+    {
+        encoded.resize(size);
+    }
+    if (Backend::exchange_needs_buffer && encoded_buffer.size() < size)
+    {
+        encoded_buffer.resize(size);
+    }
+    if (encoded_both)
+    {
+        Backend::ExchangeWithPartner(encoded.begin(), encoded.begin() + size,
+            encoded_buffer.begin(), partner_rank);
+    }
+    else
+    {
+        Backend::ExchangeWithPartner(first, last, buffer.begin(),
+            partner_rank);
+    }
+    Stats::PartnerAdd(partner_rank,
+        (encoded_both ? size : count) * sizeof(complexd),
+        Backend::Time() - start);
 
-    #ifdef DEBUG
-        cout << INDENT(3) << "WorkerBase::SwapWithPartner() return" << endl;
-    #endif
+    if (encoded_both)
+    {
+        start = Backend::Time();
+        ExchangeCodec::Decode(encoded.begin(), size, count, first);
+        Stats::CodecAdd(count * sizeof(complexd),
+            encoded_size * sizeof(complexd), encode_time,
+            Backend::Time() - start);
+    }
+    else if (encode)
+    {
+        Stats::CodecAdd(count * sizeof(complexd), count * sizeof(complexd),
+            encode_time, 0.0);
+    }
 }
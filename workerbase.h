@@ -1,23 +1,73 @@
 #ifndef WORKERBASE_H
 #define WORKERBASE_H
 
+#include <future> // future
+
 #include "computationbase.h"
+#include "computationparams.h"
 
 class WorkerBase: protected ComputationBase
 {
     friend class Master;
-    void SwapWithPartner();
-    void ApplyOperator();
-    void NormalizeGlobal();
+    friend class Bench;
+    // where a qubit is held, mask is 0 for global qubits
+    struct QubitPlace
+    {
+        bool global;
+        int value;
+        int partner_rank;
+        Index mask;
+    };
+    QubitPlace Place(const int qubit);
+    void SwapWithPartner(const int partner_rank, const int value,
+        const Index pivot_mask, const Index control_mask, const bool active);
+    void ExchangeRange(const Vector::iterator& first,
+        const Vector::iterator& last, const int partner_rank);
+    Index LocalVectorSize() const;
+    // set by SetBlockSize, 0 means default
+    static thread_local Index block_size;
+    static Index BlockSize();
+    void ApplyOperator(const Matrix& U);
+    void ApplySingle(const vector<Matrix>& single, Index& pass_count);
+    void ApplyControlled(const Matrix& U, const int target_qubit,
+        const int control_qubit);
+    void ApplyTwoQubit(const Matrix& U, const int first_qubit,
+        const int second_qubit);
     Vector buffer;
+    // scattered elements sent by SwapWithPartner
+    Vector gathered;
+    // encodings of ExchangeRange, sent and received
+    Vector encoded;
+    Vector encoded_buffer;
     Vector psi;
     Vector psi_noiseless;
+    // copy of initial state, kept only when several epsilons are computed
+    Vector psi_initial;
+    // random state of the next iteration, generated in background
+    Vector psi_next;
+    std::future<void> psi_next_ready;
     protected:
+    ComputationParams params;
     WorkerBase(const Args& args);
     complexd ScalarProduct() const;
-    void VectorInitRandom();
-    void ApplyOperatorToEachQubit();
+    void VectorInitRandomBegin(const unsigned state_seed);
+    double VectorInitRandomEnd();
+    void VectorNormalize(const double sum);
+    vector<double> GroupAllSum(const vector<double>& local) const;
+    Index GroupOffset(const Index count) const;
+    void RestoreInitialState();
+    void ApplyCircuit();
     void SwapVectors();
+    public:
+    static const Index default_block_size;
+    /*
+        Qubits with stride below block_size are transformed in one pass,
+        1 gives a pass per qubit, 0 restores the default. Out-of-core
+        vectors keep their own block size.
+    */
+    static void SetBlockSize(const Index block_size);
+    static Index MemoryPerRank(const Args& args,
+        const Index worker_vector_size);
 };
 
 #endif